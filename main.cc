@@ -1,10 +1,21 @@
 #include <cmath>
+#include <numbers>
 #include <print>
 #include <fstream>
 #include <vector>
 #include <ranges>
 #include <array>
 #include <cassert>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <cstdio>
+#include <stdexcept>
+#include <unistd.h>
 
 namespace rl {
 #include <raylib.h>
@@ -102,6 +113,42 @@ void write_to_ppm(const char* filename, const Framebuffer& fb) {
     return vertices_final;
 }
 
+// stand-in for a consumer in another process (e.g. an encoder), which maps the
+// segment of the ring a second time and reads the frames in place
+class FrameConsumer {
+    SharedFrameRing m_ring;
+    std::function<void(const SharedFrameRing::Frame&)> m_callback;
+    std::atomic<bool> m_stop = false;
+    std::thread m_thread;
+
+public:
+    FrameConsumer(int fd, std::function<void(const SharedFrameRing::Frame&)> callback)
+        : m_ring(fd)
+        , m_callback(std::move(callback))
+        , m_thread([this] { run(); })
+    { }
+
+    // frames published before the consumer is destroyed are still consumed
+    ~FrameConsumer() {
+        m_stop = true;
+        m_thread.join();
+    }
+
+private:
+    void run() {
+        while (true) {
+            bool stop = m_stop;
+            while (auto frame = m_ring.acquire_frame()) {
+                m_callback(*frame);
+                m_ring.release_frame();
+            }
+            if (stop) return;
+            std::this_thread::yield();
+        }
+    }
+
+};
+
 void test_vector_matrix() {
 
     Vec v(2, 6, 1, 1);
@@ -117,6 +164,12 @@ void test_vector_matrix() {
     assert(r.y == 103);
     assert(r.z == 163);
     assert(r.w == 33);
+
+    Vec back = m1.inverse() * r;
+    assert(std::abs(back.x - v.x) < 1e-3f);
+    assert(std::abs(back.y - v.y) < 1e-3f);
+    assert(std::abs(back.z - v.z) < 1e-3f);
+    assert(std::abs(back.w - v.w) < 1e-3f);
 }
 
 void test_translate() {
@@ -148,20 +201,1222 @@ void test_rotate() {
     assert(r.z < eps);
 }
 
+void test_transform_hierarchy() {
+
+    Transform parent(Mat::translate({1, 0, 0, 1}));
+    Transform child(Mat::scale({2, 2, 2, 1}));
+    child.set_parent(&parent);
+    parent.update();
+
+    auto r = child.get_world() * Vec(1, 1, 1, 1);
+    assert(r.x == 3);
+    assert(r.y == 2);
+    assert(r.z == 2);
+    assert(!child.is_dirty());
+
+    // changes to the parent have to propagate to the child
+    parent.set_local(Mat::translate({0, 5, 0, 1}));
+    parent.update();
+    r = child.get_world() * Vec(1, 1, 1, 1);
+    assert(r.x == 2);
+    assert(r.y == 7);
+}
+
+void test_frustum_culling() {
+
+    Mesh mesh({
+        Vec(-0.5, -0.5, 0, 1),
+        Vec( 0.5, -0.5, 0, 1),
+        Vec( 0.0,  0.5, 0, 1),
+    });
+
+    Transform inside;
+    Transform outside(Mat::translate({10, 0, 0, 1}));
+    inside.update();
+    outside.update();
+
+    Scene scene;
+    scene.add_instance(mesh, inside, default_fragment_shader);
+    auto id = scene.add_instance(mesh, outside, default_fragment_shader);
+    scene.update();
+
+    std::vector<Scene::InstanceId> visible;
+    scene.cull(Frustum(Mat::identity()), visible);
+    assert(visible.size() == 1);
+    assert(visible[0] != id);
+
+    // moving an instance refits the hierarchy
+    outside.set_local(Mat::translate({0.5, 0, 0, 1}));
+    outside.update();
+    scene.update();
+
+    visible.clear();
+    scene.cull(Frustum(Mat::identity()), visible);
+    assert(visible.size() == 2);
+
+    // scenes are rendered with the whole state of the rasterizer
+    Framebuffer fb(32, 32);
+    Rasterizer ras(fb);
+    ras.set_color_write(false);
+    assert(scene.render(ras, Mat::identity()) == 2);
+    assert(fb.get_depth(12, 16) != Framebuffer::cleared_depth);
+    assert(fb.get_color_buffer().get(12, 16).b == 0);
+}
+
+void test_backface_culling() {
+
+    Framebuffer fb(16, 16);
+    Rasterizer ras(fb);
+    ras.set_cull_mode(CullMode::Back);
+
+    std::array vertices_vp {
+        Vec(0, 0, 0, 1),
+        Vec(0, 8, 0, 1),
+        Vec(8, 0, 0, 1),
+        Vec(4, 4, 0, 1),
+    };
+
+    std::array<uint32_t, 9> indices {
+        0, 1, 2, // front facing
+        0, 2, 1, // back facing
+        0, 3, 3, // degenerate
+    };
+
+    std::array<uint32_t, 3> visible;
+    assert(ras.cull_triangles(vertices_vp, indices, visible) == 1);
+    assert(visible[0] == 0);
+
+    ras.set_cull_mode(CullMode::None);
+    assert(ras.cull_triangles(vertices_vp, indices, visible) == 2);
+}
+
+void test_mesh_simplification() {
+
+    // flat grid of 4x4 quads
+    std::vector<Vec> triangles;
+    for (int x = 0; x < 4; ++x) {
+        for (int y = 0; y < 4; ++y) {
+            Vec a(x, y, 0, 1);
+            Vec b(x+1, y, 0, 1);
+            Vec c(x+1, y+1, 0, 1);
+            Vec d(x, y+1, 0, 1);
+            triangles.insert(triangles.end(), { a, b, c, c, d, a });
+        }
+    }
+
+    auto mesh = weld_vertices(triangles);
+    assert(mesh.vertices.size() == 25);
+    assert(mesh.get_triangle_count() == 32);
+
+    auto simplified = simplify(mesh, 8);
+    assert(simplified.get_triangle_count() <= 8);
+    assert(simplified.get_triangle_count() > 0);
+
+    // the outline of the grid has to be preserved
+    auto aabb = Aabb::from_points(simplified.vertices);
+    assert(aabb.min.x == 0 && aabb.min.y == 0);
+    assert(aabb.max.x == 4 && aabb.max.y == 4);
+}
+
+void test_watertight_rasterization() {
+
+    Framebuffer fb(8, 8);
+    Rasterizer ras(fb);
+
+    // two triangles covering the whole viewport, sharing a diagonal edge which
+    // passes exactly through pixel centers
+    std::array vertices {
+        Vec(-1, -1, 0, 1),
+        Vec( 1, -1, 0, 1),
+        Vec( 1,  1, 0, 1),
+        Vec( 1,  1, 0, 1),
+        Vec(-1,  1, 0, 1),
+        Vec(-1, -1, 0, 1),
+    };
+
+    static int fragments = 0;
+    auto fs = [](const Fragment&, const Uniforms&) {
+        ++fragments;
+        return Color::white();
+    };
+
+    ras.render_vertex_buffer(vertices, default_vertex_shader, fs);
+    assert(fragments == 8 * 8);
+}
+
+void test_texture_sampling() {
+
+    ColorBuffer image(4, 2);
+    image.clear(Color::white());
+    image.write(0, 0, Color::black());
+
+    Texture texture(image);
+    assert(texture.get_level_count() == 3);
+    assert(texture.get_texel(0, 0, 0).r == 0);
+    assert(texture.get_texel(0, 3, 1).r == 0xff);
+
+    // the single texel of the last level is the average of the whole image
+    assert(texture.get_texel(2, 0, 0).r == 0xdf);
+
+    // halfway between a black and a white texel
+    auto c = texture.sample_bilinear(Vec(0.25, 0.25, 0, 0));
+    assert(c.r == 0x80);
+
+    // coordinates wrap around
+    assert(texture.sample_nearest(Vec(1.1, 1.1, 0, 0)).r == 0);
+
+    assert(texture.compute_lod(Vec(0.25, 0, 0, 0), Vec(0, 0, 0, 0)) == 0.0f);
+    assert(texture.compute_lod(Vec(0.5, 0, 0, 0), Vec(0, 0, 0, 0)) == 1.0f);
+}
+
+void test_command_buffer() {
+
+    std::array triangle {
+        Vec(-1.0, -1.0, 0.0, 1),
+        Vec( 0.8, -0.9, 0.0, 1),
+        Vec(-0.7,  1.0, 0.0, 1),
+    };
+
+    std::array quad {
+        Vec(-0.5, -0.5, 0.5, 1),
+        Vec( 1.0, -0.5, 0.5, 1),
+        Vec( 1.0,  1.0, 0.5, 1),
+        Vec( 1.0,  1.0, 0.5, 1),
+        Vec(-0.5,  1.0, 0.5, 1),
+        Vec(-0.5, -0.5, 0.5, 1),
+    };
+
+    auto fs_red = [](const Fragment&, const Uniforms&) {
+        return Color::red();
+    };
+
+    auto fs_green = [](const Fragment&, const Uniforms&) {
+        return Color::green();
+    };
+
+    // larger than a single tile
+    Framebuffer fb_immediate(150, 100);
+    Rasterizer ras_immediate(fb_immediate);
+    ras_immediate.render_vertex_buffer(triangle, default_vertex_shader, fs_red);
+    ras_immediate.render_vertex_buffer(quad, default_vertex_shader, fs_green);
+
+    // both command buffers are recorded on their own thread
+    CommandBuffer cb_triangle;
+    CommandBuffer cb_quad;
+    std::thread thread_triangle([&] {
+        cb_triangle.draw(triangle, Uniforms {}, default_vertex_shader, fs_red);
+    });
+    std::thread thread_quad([&] {
+        cb_quad.draw(quad, Uniforms {}, default_vertex_shader, fs_green);
+    });
+    thread_triangle.join();
+    thread_quad.join();
+
+    Framebuffer fb_deferred(150, 100);
+    Rasterizer ras_deferred(fb_deferred);
+    std::array command_buffers { &cb_triangle, &cb_quad };
+    ras_deferred.submit(command_buffers);
+
+    // same submission, with every stage running on multiple threads
+    JobSystem jobs(4);
+    Framebuffer fb_parallel(150, 100);
+    Rasterizer ras_parallel(fb_parallel);
+    ras_parallel.set_job_system(&jobs);
+    ras_parallel.submit(command_buffers);
+
+    for (int y = 0; y < fb_immediate.get_height(); ++y) {
+        for (int x = 0; x < fb_immediate.get_width(); ++x) {
+            assert(fb_immediate.get_color_buffer().get(x, y).r == fb_deferred.get_color_buffer().get(x, y).r);
+            assert(fb_immediate.get_color_buffer().get(x, y).g == fb_deferred.get_color_buffer().get(x, y).g);
+            assert(fb_deferred.get_color_buffer().get(x, y).r == fb_parallel.get_color_buffer().get(x, y).r);
+            assert(fb_deferred.get_color_buffer().get(x, y).g == fb_parallel.get_color_buffer().get(x, y).g);
+        }
+    }
+}
+
+void test_line_rasterization() {
+
+    Framebuffer fb(16, 16);
+    Rasterizer ras(fb);
+
+    // center of a pixel in ndc
+    auto center = [](int x, int y) {
+        return Vec((x + 0.5f) / 8 - 1, 1 - (y + 0.5f) / 8, 0, 1);
+    };
+
+    static int fragments = 0;
+    auto fs = [](const Fragment&, const Uniforms&) {
+        ++fragments;
+        return Color::white();
+    };
+
+    // cost of a line only depends on its length
+    ras.draw_line(center(2, 5), center(13, 5), Uniforms {}, default_vertex_shader, fs);
+    assert(fragments == 12);
+    for (int x = 2; x <= 13; ++x) {
+        assert(fb.get_color_buffer().get(x, 5).r == 0xff);
+    }
+
+    fragments = 0;
+    ras.draw_line(center(1, 1), center(10, 7), Uniforms {}, default_vertex_shader, fs);
+    assert(fragments == 10);
+
+    // occluded by the first line
+    fragments = 0;
+    Vec behind_a = center(2, 5);
+    Vec behind_b = center(13, 5);
+    behind_a.z = behind_b.z = -0.5f;
+    ras.draw_line(behind_a, behind_b, Uniforms {}, default_vertex_shader, fs);
+    assert(fragments == 0);
+
+    // wireframe of a submission, which is binned into tiles, matches the immediate one
+    std::array triangle {
+        Vec(-0.9, -0.8, 0.0, 1),
+        Vec( 0.8, -0.9, 0.0, 1),
+        Vec(-0.7,  0.9, 0.0, 1),
+    };
+
+    Framebuffer fb_immediate(150, 100);
+    Rasterizer ras_immediate(fb_immediate);
+    ras_immediate.set_polygon_mode(PolygonMode::Line);
+    ras_immediate.render_vertex_buffer(triangle, default_vertex_shader, fs);
+
+    Framebuffer fb_deferred(150, 100);
+    Rasterizer ras_deferred(fb_deferred);
+    CommandBuffer cb;
+    cb.set_polygon_mode(PolygonMode::Line);
+    cb.draw(triangle, Uniforms {}, default_vertex_shader, fs);
+    ras_deferred.submit(cb);
+
+    int covered = 0;
+    for (int y = 0; y < fb_immediate.get_height(); ++y) {
+        for (int x = 0; x < fb_immediate.get_width(); ++x) {
+            assert(fb_immediate.get_color_buffer().get(x, y).r == fb_deferred.get_color_buffer().get(x, y).r);
+            covered += fb_immediate.get_color_buffer().get(x, y).r != 0;
+        }
+    }
+    assert(covered > 0 && covered < 3 * 150);
+}
+
+void test_deferred_shading() {
+
+    Framebuffer fb(32, 32, GBuffer::formats);
+    Rasterizer ras(fb);
+
+    // covers the whole viewport, facing the viewer
+    std::array quad {
+        Vec(-1, -1, 0, 1),
+        Vec( 1, -1, 0, 1),
+        Vec( 1,  1, 0, 1),
+        Vec( 1,  1, 0, 1),
+        Vec(-1,  1, 0, 1),
+        Vec(-1, -1, 0, 1),
+    };
+
+    // the left columns are emissive
+    auto mts = [](const Fragment& fragment, const Uniforms&, FragmentOutputs& outputs) {
+        outputs.write(GBuffer::Normal, Vec(0, 0, 1, 0));
+        outputs.write(GBuffer::Albedo, Color::white());
+        outputs.write<uint8_t>(GBuffer::Material, fragment.position.x < 8 ? 1 : 0);
+    };
+
+    ras.render_vertex_buffer(quad, Uniforms {}, default_vertex_shader, mts);
+
+    // only reaches the center of the screen
+    std::array lights {
+        PointLight { Vec(0, 0, 0.25, 1), Color::red(), 1.0f, 0.5f },
+    };
+
+    Color ambient(0x20, 0x20, 0x20, 0xff);
+    ras.shade_deferred(lights, Mat::identity(), ambient);
+
+    Color center = fb.get_color_buffer().get(16, 16);
+    assert(center.r > 0x40);
+    assert(center.g == ambient.g);
+
+    Color corner = fb.get_color_buffer().get(0, 0);
+    assert(corner.r == ambient.r);
+
+    std::array materials {
+        SurfaceMaterial {},
+        SurfaceMaterial { 0.0f, 1.0f },
+    };
+    ras.shade_deferred(lights, Mat::identity(), ambient, materials);
+
+    Color emissive = fb.get_color_buffer().get(0, 0);
+    assert(emissive.r == 0xff && emissive.g == 0xff && emissive.b == 0xff);
+
+    Color unlit = fb.get_color_buffer().get(31, 0);
+    assert(unlit.r == ambient.r && unlit.g == ambient.g);
+    assert(fb.get_color_buffer().get(16, 16).r > 0x40);
+}
+
+void test_stencil() {
+
+    Framebuffer fb(16, 16);
+    Rasterizer ras(fb);
+    CommandBuffer commands;
+    fb.clear();
+
+    auto make_quad = [](float min_x, float max_x, float z) {
+        return std::array {
+            Vec(min_x, -1, z, 1),
+            Vec(max_x, -1, z, 1),
+            Vec(max_x,  1, z, 1),
+            Vec(max_x,  1, z, 1),
+            Vec(min_x,  1, z, 1),
+            Vec(min_x, -1, z, 1),
+        };
+    };
+
+    auto left = make_quad(-1, 0, 0.5);
+    auto screen = make_quad(-1, 1, 0.5);
+    auto behind = make_quad(-1, 1, 0);
+
+    auto fs = [](const Fragment&, const Uniforms&) {
+        return Color::red();
+    };
+
+    // the mask only writes the stencil
+    commands.set_stencil({ .enabled = true, .pass_op = StencilOp::Replace, .reference = 1 });
+    commands.set_color_write(false);
+    commands.set_depth_write(false);
+    commands.draw(left, Uniforms {}, default_vertex_shader, fs);
+
+    // is recorded after the mask, but would be sorted before it by its state
+    commands.set_stencil({ .enabled = true, .compare = CompareFunction::Equal, .reference = 1 });
+    commands.set_color_write(true);
+    commands.set_depth_write(true);
+    commands.draw(screen, Uniforms {}, default_vertex_shader, fs);
+
+    // counts the fragments hidden behind the screen
+    commands.set_stencil({ .enabled = true, .depth_fail_op = StencilOp::IncrementClamp });
+    commands.set_color_write(false);
+    commands.draw(behind, Uniforms {}, default_vertex_shader, fs);
+
+    ras.submit(commands);
+
+    assert(fb.get_color_buffer().get(4, 8).r == 0xff);
+    assert(fb.get_color_buffer().get(12, 8).r == 0);
+    assert(fb.get_depth(4, 8) == 0.5f && fb.get_depth(12, 8) == 0.0f);
+    assert(fb.get_stencil(4, 8) == 2 && fb.get_stencil(12, 8) == 0);
+}
+
+void test_pipeline_state() {
+
+    Framebuffer fb(16, 16);
+    Rasterizer ras(fb);
+    CommandBuffer commands;
+    fb.clear();
+
+    auto make_quad = [](float min_x, float max_x, float z) {
+        return std::array {
+            Vec(min_x, -1, z, 1),
+            Vec(max_x, -1, z, 1),
+            Vec(max_x,  1, z, 1),
+            Vec(max_x,  1, z, 1),
+            Vec(min_x,  1, z, 1),
+            Vec(min_x, -1, z, 1),
+        };
+    };
+
+    auto front = make_quad(-1, 1, 0.5);
+    auto behind = make_quad(-1, 0, 0);
+    auto middle = make_quad(-1, 1, 0.2);
+
+    auto red = [](const Fragment&, const Uniforms&) {
+        return Color::red();
+    };
+    auto translucent_green = [](const Fragment&, const Uniforms&) {
+        return Color(0x0, 0xff, 0x0, 0x80);
+    };
+    auto translucent_blue = [](const Fragment&, const Uniforms&) {
+        return Color(0x0, 0x0, 0xff, 0x80);
+    };
+
+    ras.render_vertex_buffer(front, default_vertex_shader, red);
+
+    // is drawn over the front quad, and replaces its color
+    ras.set_depth_test(false);
+    ras.set_blending(false);
+    ras.render_vertex_buffer(behind, default_vertex_shader, translucent_green);
+
+    Color replaced = fb.get_color_buffer().get(4, 8);
+    assert(replaced.r == 0 && replaced.g == 0xff && replaced.a == 0x80);
+    assert(fb.get_depth(4, 8) == 0.0f && fb.get_depth(12, 8) == 0.5f);
+
+    // only passes the depth test on the left half
+    commands.draw(middle, Uniforms {}, default_vertex_shader, translucent_blue);
+    ras.submit(commands);
+
+    Color blended = fb.get_color_buffer().get(4, 8);
+    assert(blended.g > 0 && blended.b > 0);
+    assert(fb.get_color_buffer().get(12, 8).r == 0xff);
+    assert(fb.get_color_buffer().get(12, 8).b == 0);
+}
+
+void test_order_independent_transparency() {
+
+    auto make_quad = [](float min_x, float max_x, float z) {
+        return std::array {
+            Vec(min_x, -1, z, 1),
+            Vec(max_x, -1, z, 1),
+            Vec(max_x,  1, z, 1),
+            Vec(max_x,  1, z, 1),
+            Vec(min_x,  1, z, 1),
+            Vec(min_x, -1, z, 1),
+        };
+    };
+
+    auto background = make_quad(-1, 1, 0);
+    // between the layers, and only covering the left half
+    auto occluder = make_quad(-1, 0, 0.5);
+    std::array layers { make_quad(-1, 1, 0.2), make_quad(-1, 1, 0.4), make_quad(-1, 1, 0.6) };
+
+    // different shaders, so that the draws are also reordered by their state
+    std::array<FragmentShader*, 3> shaders {
+        [](const Fragment&, const Uniforms&) { return Color(0xff, 0x0, 0x0, 0x80); },
+        [](const Fragment&, const Uniforms&) { return Color(0x0, 0xff, 0x0, 0x60); },
+        [](const Fragment&, const Uniforms&) { return Color(0xff, 0xff, 0xff, 0x40); },
+    };
+
+    // blended back to front in submission order
+    Framebuffer fb_reference(16, 16);
+    Rasterizer ras_reference(fb_reference);
+    ras_reference.render_vertex_buffer(background, default_vertex_shader, default_fragment_shader);
+    ras_reference.render_vertex_buffer(layers[0], default_vertex_shader, shaders[0]);
+    ras_reference.render_vertex_buffer(layers[1], default_vertex_shader, shaders[1]);
+    ras_reference.render_vertex_buffer(occluder, default_vertex_shader, default_fragment_shader);
+    ras_reference.render_vertex_buffer(layers[2], default_vertex_shader, shaders[2]);
+
+    auto matches_reference = [&](const Framebuffer& fb) {
+        for (int y = 0; y < fb.get_height(); ++y) {
+            for (int x = 0; x < fb.get_width(); ++x) {
+                Color color = fb.get_color_buffer().get(x, y);
+                Color expected = fb_reference.get_color_buffer().get(x, y);
+                if (color.r != expected.r || color.g != expected.g || color.b != expected.b) return false;
+            }
+        }
+        return true;
+    };
+
+    Framebuffer fb(16, 16);
+    Rasterizer ras(fb);
+    CommandBuffer commands;
+
+    commands.set_transparent(true);
+    commands.draw(layers[2], Uniforms {}, default_vertex_shader, shaders[2]);
+    commands.draw(layers[0], Uniforms {}, default_vertex_shader, shaders[0]);
+    commands.set_transparent(false);
+    commands.draw(occluder, Uniforms {}, default_vertex_shader, default_fragment_shader);
+    commands.draw(background, Uniforms {}, default_vertex_shader, default_fragment_shader);
+    commands.set_transparent(true);
+    commands.draw(layers[1], Uniforms {}, default_vertex_shader, shaders[1]);
+    ras.submit(commands);
+
+    assert(matches_reference(fb));
+    // transparent draws don't write the depth
+    assert(fb.get_depth(12, 8) == 0.0f && fb.get_depth(4, 8) == 0.5f);
+
+    // more layers than a pixel can keep, arriving back to front, which the fallback blends exactly
+    Framebuffer fb_layers_reference(16, 16);
+    Rasterizer ras_layers_reference(fb_layers_reference);
+    fb.clear();
+    commands.reset();
+    commands.set_transparent(true);
+
+    std::vector<std::array<Vec, 6>> many_layers;
+    for (int i = 0; i < 12; ++i) {
+        many_layers.push_back(make_quad(-1, 1, i / 12.0f));
+    }
+    for (auto& layer : many_layers) {
+        ras_layers_reference.render_vertex_buffer(layer, default_vertex_shader, shaders[0]);
+        commands.draw(layer, Uniforms {}, default_vertex_shader, shaders[0]);
+    }
+    ras.submit(commands);
+
+    Color color = fb.get_color_buffer().get(8, 8);
+    Color expected = fb_layers_reference.get_color_buffer().get(8, 8);
+    assert(color.r == expected.r && color.r > 0xf0);
+}
+
+void test_dynamic_resolution() {
+
+    std::array vertices {
+        Vec(-0.9, -0.8, -0.5, 1),
+        Vec( 0.8, -0.9,  0.5, 1),
+        Vec(-0.1,  0.9,  0.0, 1),
+    };
+
+    // a viewport renders the same pixels as a framebuffer of its size
+    Framebuffer fb_reference(24, 18);
+    Rasterizer ras_reference(fb_reference);
+    ras_reference.render_vertex_buffer(vertices, default_vertex_shader, default_fragment_shader);
+
+    Framebuffer fb(40, 30);
+    Rasterizer ras(fb);
+    ras.set_viewport(24, 18);
+    ras.render_vertex_buffer(vertices, default_vertex_shader, default_fragment_shader);
+
+    for (int y = 0; y < fb.get_height(); ++y) {
+        for (int x = 0; x < fb.get_width(); ++x) {
+            bool inside = x < 24 && y < 18;
+            assert(fb.get_depth(x, y) == (inside ? fb_reference.get_depth(x, y) : Framebuffer::cleared_depth));
+        }
+    }
+
+    // the scale follows the frame time, within its limits
+    ResolutionController resolution(1600, 900, 1.0f / 60.0f, 0.5f);
+    for (int i = 0; i < 100; ++i) {
+        resolution.update(1.0f / 20.0f);
+    }
+    assert(resolution.get_width() == 800 && resolution.get_height() == 450);
+
+    for (int i = 0; i < 100; ++i) {
+        resolution.update(1.0f / 60.0f * resolution.get_scale() * resolution.get_scale() / 0.64f);
+    }
+    assert(std::abs(resolution.get_scale() - 0.8f) < 0.05f);
+
+    for (int i = 0; i < 100; ++i) {
+        resolution.update(1.0f / 200.0f);
+    }
+    assert(resolution.get_width() == 1600 && resolution.get_height() == 900);
+
+    // a gradient stays a gradient, and the corners keep the colors of the source corners
+    ColorBuffer source(400, 4);
+    source.clear(Color::white());
+    for (int y = 0; y < 2; ++y) {
+        for (int x = 0; x < 300; ++x) {
+            source.write(x, y, Color(x * 0xff / 299, y * 0xff, 0x0, 0xff));
+        }
+    }
+
+    ColorBuffer target(700, 5);
+    upscale_bilinear(source, 300, 2, target);
+
+    assert(target.get(0, 0).r == 0 && target.get(0, 0).g == 0);
+    assert(target.get(699, 4).r == 0xff && target.get(699, 4).g == 0xff);
+    for (int x = 1; x < target.get_width(); ++x) {
+        assert(target.get(x, 2).r >= target.get(x - 1, 2).r);
+        assert(target.get(x, 2).b == 0 && target.get(x, 2).a == 0xff);
+    }
+}
+
+void test_depth_pass() {
+
+    // two intersecting triangles with sloped depths
+    std::array vertices {
+        Vec(-0.9, -0.8, -0.5, 1),
+        Vec( 0.8, -0.9,  0.5, 1),
+        Vec(-0.1,  0.9,  0.0, 1),
+        Vec(-0.8,  0.7,  0.6, 1),
+        Vec( 0.9,  0.2, -0.4, 1),
+        Vec( 0.0, -0.9,  0.1, 1),
+    };
+    std::array<uint32_t, 6> indices { 0, 1, 2, 3, 4, 5 };
+
+    // tall enough to span several bands of the depth pass
+    Framebuffer fb_color(40, 150);
+    Rasterizer ras_color(fb_color);
+    ras_color.render_indexed(vertices, indices, Uniforms {}, default_vertex_shader, default_fragment_shader);
+
+    JobSystem jobs(4);
+    Framebuffer fb(40, 150);
+    Rasterizer ras(fb);
+    ras.set_job_system(&jobs);
+    ras.render_depth(vertices, indices, Uniforms {}, default_vertex_shader);
+
+    DepthBuffer shadow_map(40, 150);
+    shadow_map.clear(Framebuffer::cleared_depth);
+    ras.render_depth(vertices, indices, Uniforms {}, default_vertex_shader, shadow_map);
+
+    size_t covered = 0;
+    for (int y = 0; y < fb.get_height(); ++y) {
+        for (int x = 0; x < fb.get_width(); ++x) {
+            assert(fb.get_depth(x, y) == fb_color.get_depth(x, y));
+            assert(shadow_map.get(x, y) == fb_color.get_depth(x, y));
+            assert(fb.get_color_buffer().get(x, y).r == 0);
+            covered += fb.get_depth(x, y) != Framebuffer::cleared_depth;
+        }
+    }
+    assert(covered > 0);
+
+    // the viewport covers the whole depth buffer, independently of the framebuffer size
+    DepthBuffer small_map(8, 4);
+    small_map.clear(Framebuffer::cleared_depth);
+    ras.render_depth(vertices, indices, Uniforms {}, default_vertex_shader, small_map);
+    assert(small_map.get(4, 2) != Framebuffer::cleared_depth);
+}
+
+void test_occlusion_queries() {
+
+    // wall covering the left half of the viewport
+    std::array wall {
+        Vec(-1, -1, 0.5, 1),
+        Vec( 0, -1, 0.5, 1),
+        Vec( 0,  1, 0.5, 1),
+        Vec( 0,  1, 0.5, 1),
+        Vec(-1,  1, 0.5, 1),
+        Vec(-1, -1, 0.5, 1),
+    };
+
+    JobSystem jobs(4);
+    Framebuffer fb(32, 32);
+    Rasterizer ras(fb);
+    ras.set_job_system(&jobs);
+    ras.render_vertex_buffer(wall, default_vertex_shader, default_fragment_shader);
+
+    // every box covers 8x16 pixels
+    Aabb behind { Vec(-0.75, -0.5, -0.5, 1), Vec(-0.25, 0.5, 0.0, 1) };
+    Aabb in_front { Vec(-0.75, -0.5, 0.6, 1), Vec(-0.25, 0.5, 0.8, 1) };
+    Aabb beside { Vec(0.25, -0.5, -0.5, 1), Vec(0.75, 0.5, 0.0, 1) };
+    // half of it sticks out from behind the wall
+    Aabb straddling { Vec(-0.25, -0.5, -0.5, 1), Vec(0.25, 0.5, 0.0, 1) };
+
+    auto query = [&](const Aabb& box, const Uniforms& uniforms = {}) {
+        ras.begin_query();
+        ras.query_box(box, uniforms);
+        return ras.end_query();
+    };
+
+    assert(query(behind) == 0);
+    assert(!ras.is_box_visible(behind, Uniforms {}));
+    assert(query(in_front) == 128);
+    assert(query(beside) == 128);
+    assert(ras.is_box_visible(beside, Uniforms {}));
+    assert(query(straddling) == 64);
+
+    // queries add up the pixels of all boxes
+    ras.begin_query();
+    ras.query_box(behind, Uniforms {});
+    ras.query_box(beside, Uniforms {});
+    ras.query_box(straddling, Uniforms {});
+    assert(ras.end_query() == 192);
+
+    // a rotated box covers the same pixels as its faces, which are seen from both sides
+    Aabb box { Vec(0.1, -0.3, -0.3, 1), Vec(0.7, 0.3, 0.3, 1) };
+    auto rotated = Uniforms::from_model(Mat::rotate(Vec {1.0f, 1.0f, 0.0f, 1.0f}, deg_to_rad(30)), Mat::identity());
+
+    std::array<Vec, 8> corners;
+    for (size_t i = 0; i < corners.size(); ++i) {
+        corners[i] = Vec(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z, 1);
+    }
+    std::array<uint32_t, 36> box_indices {
+        0, 2, 6, 0, 6, 4, 1, 3, 7, 1, 7, 5,
+        0, 1, 5, 0, 5, 4, 2, 3, 7, 2, 7, 6,
+        0, 1, 3, 0, 3, 2, 4, 5, 7, 4, 7, 6,
+    };
+
+    Framebuffer fb_box(32, 32);
+    Rasterizer ras_box(fb_box);
+    ras_box.render_indexed(corners, box_indices, rotated, default_vertex_shader, default_fragment_shader);
+    size_t covered = 0;
+    for (int y = 0; y < fb_box.get_height(); ++y) {
+        for (int x = 0; x < fb_box.get_width(); ++x) {
+            covered += fb_box.get_depth(x, y) != Framebuffer::cleared_depth;
+        }
+    }
+
+    ras_box.begin_query();
+    ras_box.query_box(box, rotated);
+    assert(ras_box.end_query() == covered);
+
+    // nothing is written
+    for (int y = 0; y < fb.get_height(); ++y) {
+        for (int x = 0; x < fb.get_width(); ++x) {
+            assert(fb.get_depth(x, y) == (x < 16 ? 0.5f : Framebuffer::cleared_depth));
+        }
+    }
+}
+
+void test_quantized_vertices() {
+
+    // grid of quads, with texture coordinates and normals bending away from the center
+    std::vector<Vec> positions;
+    std::vector<Vec> uvs;
+    std::vector<Vec> normals;
+    std::vector<uint32_t> indices;
+    constexpr int size = 9;
+
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            float u = x / (size - 1.0f);
+            float v = y / (size - 1.0f);
+            positions.push_back(Vec(u * 1.6f - 0.8f, v * 1.4f - 0.7f, u * v - 0.5f, 1));
+            uvs.push_back(Vec(u, v, 0, 0));
+            normals.push_back(Vec(u - 0.5f, v - 0.5f, u * v - 0.5f, 0).normalized());
+
+            if (x + 1 < size && y + 1 < size) {
+                uint32_t i = y * size + x;
+                indices.insert(indices.end(), { i, i + 1, i + size + 1, i, i + size + 1, i + size });
+            }
+        }
+    }
+
+    auto quantized_uvs = QuantizedVertices::quantize(positions, uvs, AttributeFormat::Half2);
+    auto quantized_normals = QuantizedVertices::quantize(positions, normals, AttributeFormat::Octahedral);
+    assert(quantized_uvs.size() == positions.size());
+
+    std::vector<Vec> decoded(positions.size());
+    std::vector<Vec> decoded_uvs(positions.size());
+    std::vector<Vec> decoded_normals(positions.size());
+    quantized_uvs.decode_positions(0, decoded);
+    quantized_uvs.decode_attributes(0, decoded_uvs);
+    quantized_normals.decode_attributes(0, decoded_normals);
+
+    // 81 vertices, so the last one is decoded without vectors
+    for (size_t i = 0; i < positions.size(); ++i) {
+        Vec error = decoded[i] - positions[i];
+        error.w = 0.0f;
+        assert(error.length() < 1e-4f && decoded[i].w == 1.0f);
+        assert(decoded[i].x == quantized_uvs.get_position(i).x);
+
+        assert(decoded_uvs[i].x == quantized_uvs.get_attribute(i).x);
+        assert(std::abs(decoded_uvs[i].x - uvs[i].x) < 1e-3f && std::abs(decoded_uvs[i].y - uvs[i].y) < 1e-3f);
+
+        Vec normal = quantized_normals.get_attribute(i);
+        assert((decoded_normals[i] - normal).length() < 1e-6f && decoded_normals[i].w == 0.0f);
+        assert(normal.dot(normals[i]) > 0.99999f);
+    }
+
+    // the decoded vertices render like full vertices with the same values, the
+    // folded decoding of the default vertex shader rounds differently, which may
+    // move the depths by a few ulps and flip pixels on the edges of triangles
+    auto fs = [](const Fragment& fragment, const Uniforms&) {
+        return Color(fragment.attribute.x * 0xff, fragment.attribute.y * 0xff, 0x0, 0xff);
+    };
+
+    Mat model = Mat::rotate(Vec(1, 1, 0, 0).normalized(), 0.4f) * Mat::scale(Vec(0.9f, 1.1f, 0.8f, 1));
+    auto uniforms = Uniforms::from_model(model, Mat::identity());
+
+    Framebuffer fb_reference(48, 48);
+    Rasterizer ras_reference(fb_reference);
+    ras_reference.render_indexed(decoded, indices, uniforms, default_vertex_shader, fs, decoded_uvs);
+
+    Framebuffer fb(48, 48);
+    Rasterizer ras(fb);
+    ras.render_indexed(quantized_uvs, indices, uniforms, default_vertex_shader, fs);
+
+    size_t covered = 0;
+    size_t mismatched = 0;
+    for (int y = 0; y < fb.get_height(); ++y) {
+        for (int x = 0; x < fb.get_width(); ++x) {
+            Color color = fb.get_color_buffer().get(x, y);
+            Color expected = fb_reference.get_color_buffer().get(x, y);
+            bool same_coverage = (fb.get_depth(x, y) == Framebuffer::cleared_depth)
+                              == (fb_reference.get_depth(x, y) == Framebuffer::cleared_depth);
+
+            if (!same_coverage) {
+                ++mismatched;
+                continue;
+            }
+
+            assert(std::abs(color.r - expected.r) <= 1 && std::abs(color.g - expected.g) <= 1);
+            assert(std::abs(fb.get_depth(x, y) - fb_reference.get_depth(x, y)) < 1e-4f);
+            covered += fb.get_depth(x, y) != Framebuffer::cleared_depth;
+        }
+    }
+    assert(covered > 0);
+    assert(mismatched <= 4);
+}
+
+void test_retained_mode() {
+
+    // 4x2 tiles
+    Framebuffer fb(256, 128);
+    Framebuffer fb_reference(256, 128);
+    Rasterizer ras(fb);
+    Rasterizer ras_reference(fb_reference);
+    ras.set_retained(true);
+
+    // small quad at the center of the first tile
+    std::array quad {
+        Vec(-0.8, 0.4, 0, 1),
+        Vec(-0.7, 0.4, 0, 1),
+        Vec(-0.7, 0.6, 0, 1),
+        Vec(-0.7, 0.6, 0, 1),
+        Vec(-0.8, 0.6, 0, 1),
+        Vec(-0.8, 0.4, 0, 1),
+    };
+
+    auto fs = [](const Fragment&, const Uniforms&) {
+        return Color::green();
+    };
+
+    // a frame made of several submissions and an immediate draw, which are
+    // all compared with the previous frame
+    auto render_frame = [&](float moving_x) {
+        // static quads in the tiles of the bottom row
+        CommandBuffer left;
+        CommandBuffer right;
+        for (float x : { -0.0f, 0.5f, 1.0f, 1.5f }) {
+            CommandBuffer& commands = x < 1.0f ? left : right;
+            commands.draw(quad, Uniforms::from_model(Mat::translate({ x, -1, 0, 1 }), Mat::identity()),
+                          default_vertex_shader, fs);
+        }
+        auto moving = Uniforms::from_model(Mat::translate({ moving_x, 0, 0, 1 }), Mat::identity());
+
+        fb_reference.clear();
+        for (Rasterizer* rasterizer : { &ras, &ras_reference }) {
+            rasterizer->begin_frame();
+            rasterizer->submit(left);
+            rasterizer->submit(right);
+            rasterizer->render_vertex_buffer(quad, moving, default_vertex_shader, fs);
+            rasterizer->end_frame();
+        }
+
+        for (int y = 0; y < fb.get_height(); ++y) {
+            for (int x = 0; x < fb.get_width(); ++x) {
+                assert(fb.get_color_buffer().get(x, y).g == fb_reference.get_color_buffer().get(x, y).g);
+            }
+        }
+    };
+
+    render_frame(0);
+    assert(ras.get_redrawn_tile_count() == 8);
+
+    render_frame(0);
+    assert(ras.get_redrawn_tile_count() == 0);
+
+    // moves from the first to the second tile
+    render_frame(0.5);
+    assert(ras.get_redrawn_tile_count() == 2);
+
+    // clearing the framebuffer redraws everything
+    fb.clear();
+    render_frame(0.5);
+    assert(ras.get_redrawn_tile_count() == 8);
+}
+
+void test_instanced_drawing() {
+
+    Mesh mesh({
+        Vec(-0.2, -0.2, 0, 1),
+        Vec( 0.2, -0.2, 0, 1),
+        Vec( 0.0,  0.2, 0, 1),
+    });
+
+    // the bounding sphere of the mesh has a radius of about 0.28
+    std::array instances {
+        Mat::translate({ -0.5, 0, 0, 1 }),
+        Mat::translate({  0.5, 0.3, 0.2, 1 }),
+        // partially inside of the view frustum
+        Mat::translate({  1.1, -0.5, 0, 1 }),
+        // outside of the view frustum, the first one just so
+        Mat::translate({  1.35, 0.5, 0, 1 }),
+        Mat::translate({  5.0, 0, 0, 1 }),
+    };
+
+    Framebuffer fb(64, 64);
+    Framebuffer fb_reference(64, 64);
+    Rasterizer ras(fb);
+    Rasterizer ras_reference(fb_reference);
+
+    ras.render_instanced(mesh, instances, Uniforms {}, default_vertex_shader, default_fragment_shader);
+    assert(ras.get_submitted_draw_count() == 3);
+
+    for (auto& model : instances) {
+        auto uniforms = Uniforms::from_model(model, Mat::identity());
+        ras_reference.render_vertex_buffer(mesh.vertices, uniforms, default_vertex_shader, default_fragment_shader);
+    }
+
+    size_t covered = 0;
+    for (int y = 0; y < fb.get_height(); ++y) {
+        for (int x = 0; x < fb.get_width(); ++x) {
+            assert(fb.get_color_buffer().get(x, y).b == fb_reference.get_color_buffer().get(x, y).b);
+            assert(fb.get_depth(x, y) == fb_reference.get_depth(x, y));
+            covered += fb.get_depth(x, y) != Framebuffer::cleared_depth;
+        }
+    }
+    assert(covered > 0);
+}
+
+void test_multiple_render_targets() {
+
+    Framebuffer fb(16, 16, { Format::R32UI, Format::R32F, Format::RGBA16F });
+    Rasterizer ras(fb);
+    CommandBuffer commands;
+
+    // left half of the viewport
+    std::array quad {
+        Vec(-1, -1, 0.5, 1),
+        Vec( 0, -1, 0.5, 1),
+        Vec( 0,  1, 0.5, 1),
+        Vec( 0,  1, 0.5, 1),
+        Vec(-1,  1, 0.5, 1),
+        Vec(-1, -1, 0.5, 1),
+    };
+
+    // writes the color, an object id for picking, and the depth in a single pass
+    auto mts = [](const Fragment& fragment, const Uniforms&, FragmentOutputs& outputs) {
+        outputs.write_color(Color::blue());
+        outputs.write<uint32_t>(0, 42);
+        outputs.write(1, fragment.position.z);
+        outputs.write(2, Vec(0.25, -0.5, 1, 0));
+    };
+
+    commands.draw(quad, Uniforms {}, default_vertex_shader, mts);
+    ras.submit(commands);
+
+    auto& ids = fb.get_attachment(0).get<uint32_t>();
+    auto& depths = fb.get_attachment(1).get<float>();
+    Vec vector = fb.get_attachment(2).get<Half4>().get(4, 8).to_vec();
+
+    assert(fb.get_color_buffer().get(4, 8).b == 0xff);
+    assert(ids.get(4, 8) == 42 && ids.get(12, 8) == 0);
+    assert(depths.get(4, 8) == 0.5f && depths.get(12, 8) == 0.0f);
+    assert(vector.x == 0.25f && vector.y == -0.5f && vector.z == 1.0f);
+
+    fb.clear();
+    assert(ids.get(4, 8) == 0);
+}
+
+void test_shared_frames() {
+
+    // the producer can't get ahead of the consumer by more than the slots of the ring
+    SharedFrameRing full_ring(4, 4, 2);
+    for (int i = 0; i < 2; ++i) {
+        assert(!full_ring.begin_frame().empty());
+        full_ring.end_frame();
+    }
+    assert(full_ring.begin_frame().empty());
+
+    SharedFrameRing full_consumer(full_ring.get_fd());
+    auto frame = full_consumer.acquire_frame();
+    assert(frame && frame->sequence == 0);
+    // slots are only handed back once the consumer is done with them
+    assert(full_ring.begin_frame().empty());
+    full_consumer.release_frame();
+    assert(!full_ring.begin_frame().empty());
+
+    // segments that aren't frame rings are rejected
+    auto maps_ring = [](size_t size) {
+        std::FILE* file = std::tmpfile();
+        assert(file);
+        std::vector<char> zeros(size);
+        std::fwrite(zeros.data(), 1, zeros.size(), file);
+        std::fflush(file);
+        bool mapped = true;
+        try {
+            SharedFrameRing segment(fileno(file));
+        } catch (const std::runtime_error&) {
+            mapped = false;
+        }
+        std::fclose(file);
+        return mapped;
+    };
+    assert(!maps_ring(0));
+    assert(!maps_ring(4096));
+
+    // the header is only trusted while it is checked, the slot count, width and
+    // height written after the start of the header are zeroed once it is mapped
+    {
+        SharedFrameRing producer(4, 4, 2);
+        SharedFrameRing consumer(producer.get_fd());
+        std::array<char, 12> zeros {};
+        [[maybe_unused]] auto written = pwrite(producer.get_fd(), zeros.data(), zeros.size(), sizeof(uint32_t));
+        assert(written == static_cast<ssize_t>(zeros.size()));
+
+        assert(consumer.get_slot_count() == 2 && consumer.get_width() == 4 && consumer.get_height() == 4);
+        assert(!producer.begin_frame().empty());
+        producer.end_frame();
+        auto acquired = consumer.acquire_frame();
+        assert(acquired && acquired->width == 4 && acquired->pixels.size() == 16);
+        consumer.release_frame();
+    }
+
+    // frames rendered into the ring, and read from a second mapping of it
+    SharedFrameRing ring(32, 16, 2);
+    Framebuffer fb(ring.get_width(), ring.get_height());
+    Rasterizer ras(fb);
+
+    std::array vertices {
+        Vec(-1, -1, 0, 1),
+        Vec( 1, -1, 0, 1),
+        Vec(-1,  1, 0, 1),
+    };
+
+    constexpr int frame_count = 10;
+    std::vector<uint64_t> sequences;
+    std::vector<Color> markers;
+    std::vector<Color> covered;
+
+    {
+        FrameConsumer consumer(ring.get_fd(), [&](const SharedFrameRing::Frame& frame) {
+            assert(frame.width == 32 && frame.height == 16);
+            sequences.push_back(frame.sequence);
+            markers.push_back(frame.pixels[frame.width - 1]);
+            covered.push_back(frame.pixels[frame.height / 2 * frame.width]);
+        });
+
+        for (int i = 0; i < frame_count; ++i) {
+            std::span<Color> pixels;
+            while ((pixels = ring.begin_frame()).empty()) {
+                std::this_thread::yield();
+            }
+            fb.get_color_buffer().set_storage(pixels);
+            fb.clear();
+            ras.render_vertex_buffer(vertices, default_vertex_shader, default_fragment_shader);
+            // the right column isn't covered by the triangle
+            fb.get_color_buffer().write(fb.get_width() - 1, 0, Color(i, 0x0, 0x0, 0xff));
+            ring.end_frame();
+        }
+    }
+
+    assert(sequences.size() == frame_count);
+    for (int i = 0; i < frame_count; ++i) {
+        assert(sequences[i] == static_cast<uint64_t>(i));
+        assert(markers[i].r == i);
+        assert(covered[i].r == 0x0 && covered[i].b == 0xff);
+    }
+}
+
+void test_job_system() {
+
+    JobSystem jobs(4);
+
+    std::vector<int> values(10000, 0);
+    jobs.parallel_for(values.size(), 64, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            values[i] = i;
+        }
+    });
+    for (size_t i = 0; i < values.size(); ++i) {
+        assert(values[i] == static_cast<int>(i));
+    }
+
+    // jobs waiting for jobs they scheduled themselves, which only finishes if
+    // waiting workers keep running jobs
+    std::atomic<int> sum = 0;
+    jobs.parallel_for(16, 1, [&](size_t, size_t) {
+        jobs.parallel_for(16, 1, [&](size_t, size_t) {
+            ++sum;
+        });
+    });
+    assert(sum == 256);
+
+    // stages depending on each other
+    JobCounter first;
+    std::atomic<int> first_done = 0;
+    auto first_stage = [&](size_t, size_t) { ++first_done; };
+    jobs.parallel_for(8, 1, first, first_stage);
+    jobs.wait(first);
+    assert(first.is_done());
+    assert(first_done == 8);
+
+    // workers of another job system are worker 0 of this one, so that a
+    // rasterizer can be driven from the jobs of a larger job system
+    JobSystem small_jobs(2);
+    Framebuffer fb(64, 64);
+    Rasterizer ras(fb);
+    ras.set_job_system(&small_jobs);
+    std::array triangle {
+        Vec(-1, -1, 0, 1),
+        Vec( 1, -1, 0, 1),
+        Vec( 0,  1, 0, 1),
+    };
+
+    std::mutex ras_mutex;
+    jobs.parallel_for(jobs.get_thread_count(), 1, [&](size_t, size_t) {
+        assert(jobs.get_thread_index() < jobs.get_thread_count());
+        assert(small_jobs.get_thread_index() == 0);
+
+        std::lock_guard lock(ras_mutex);
+        CommandBuffer commands;
+        commands.draw(triangle, Uniforms {}, default_vertex_shader, default_fragment_shader);
+        ras.submit(commands);
+    });
+    assert(fb.get_color_buffer().get(32, 32).b == 0xff);
+}
+
+void test_steady_state_allocations() {
+
+    std::array triangle {
+        Vec(-1.0, -1.0, 0.0, 1),
+        Vec( 0.8, -0.9, 0.0, 1),
+        Vec(-0.7,  1.0, 0.0, 1),
+    };
+
+    auto fs = [](const Fragment&, const Uniforms&) {
+        return Color::red();
+    };
+
+    std::array<uint32_t, 3> indices { 0, 1, 2 };
+
+    JobSystem jobs(4);
+    Framebuffer fb(150, 100);
+    Rasterizer ras(fb);
+    ras.set_job_system(&jobs);
+    CommandBuffer cb;
+
+    // the framebuffer is never cleared, the frames reset the arena by themselves
+    auto render_frame = [&] {
+        ras.begin_frame();
+        ras.render_depth(triangle, indices, Uniforms {}, default_vertex_shader);
+        ras.render_vertex_buffer(triangle, default_vertex_shader, fs);
+        cb.reset();
+        cb.draw(triangle, Uniforms {}, default_vertex_shader, fs);
+        cb.draw(triangle, Uniforms {}, default_vertex_shader, fs);
+        ras.submit(cb);
+        ras.end_frame();
+    };
+
+    // the first frames grow the arena and the command buffer to their final size
+    for (int i = 0; i < 3; ++i) {
+        render_frame();
+    }
+
+    size_t arena_capacity = ras.get_frame_arena().get_capacity();
+    size_t command_capacity = cb.get_capacity();
+    for (int i = 0; i < 100; ++i) {
+        render_frame();
+    }
+    assert(ras.get_frame_arena().get_capacity() == arena_capacity);
+    assert(cb.get_capacity() == command_capacity);
+
+    // draws outside of frames only keep their own allocations
+    for (int i = 0; i < 100; ++i) {
+        ras.render_depth(triangle, indices, Uniforms {}, default_vertex_shader);
+    }
+    assert(ras.get_frame_arena().get_capacity() == arena_capacity);
+}
+
 void test() {
 
     test_vector_matrix();
     test_translate();
     test_scale();
     test_rotate();
+    test_transform_hierarchy();
+    test_frustum_culling();
+    test_backface_culling();
+    test_mesh_simplification();
+    test_watertight_rasterization();
+    test_texture_sampling();
+    test_command_buffer();
+    test_line_rasterization();
+    test_deferred_shading();
+    test_stencil();
+    test_pipeline_state();
+    test_order_independent_transparency();
+    test_dynamic_resolution();
+    test_depth_pass();
+    test_occlusion_queries();
+    test_quantized_vertices();
+    test_retained_mode();
+    test_instanced_drawing();
+    test_multiple_render_targets();
+    test_shared_frames();
+    test_job_system();
+    test_steady_state_allocations();
 
 }
 
-void draw_framebuffer_raylib(const Framebuffer& fb) {
+void draw_framebuffer_raylib(const ColorBuffer& fb) {
 
     for (int y = 0; y < fb.get_height(); ++y) {
         for (int x = 0; x < fb.get_width(); ++x) {
-            rl::Color c = std::bit_cast<rl::Color>(fb.get_color_buffer().get(x, y));
+            rl::Color c = std::bit_cast<rl::Color>(fb.get(x, y));
 
             // float d = (depth_buffer.get(x, y) + 1) / 2;
             // rl::Color c(d*0xff, d*0xff, d*0xff, 0xff);
@@ -173,24 +1428,108 @@ void draw_framebuffer_raylib(const Framebuffer& fb) {
     }
 }
 
-void demo_obj(Rasterizer& ras, const char* filename) {
+void demo_obj(Rasterizer& ras, std::span<const Vec> vertices, const Transform& transform) {
+
+    auto fs = [](const Fragment& fragment, const Uniforms&) {
+        // brighter towards the viewer
+        float shade = (fragment.position.z + 1) / 2;
+        return Color(0x0, 0x0, static_cast<uint8_t>(0xff * shade), 0xff);
+    };
 
-    auto obj_vertices = load_obj(filename);
+    auto uniforms = Uniforms::from_model(transform.get_world(), Mat::identity());
+    ras.render_vertex_buffer(vertices, uniforms, default_vertex_shader, fs);
 
-    auto vs = [](Vec p) {
-        float s = 0.2;
-        auto scale = Mat::scale({s, s, s, 1});
-        auto angle = fmodf((rl::GetTime() * 30), 360);
-        auto rot = Mat::rotate(Vec {1.0f, 1.0f, 0.0f, 1.0f}, deg_to_rad(angle));
-        return rot * scale * p;
+}
+
+// solid model, with its wireframe on top
+void demo_wireframe(Rasterizer& ras, std::span<const Vec> vertices, const Transform& transform) {
+
+    demo_obj(ras, vertices, transform);
+
+    // moves the edges slightly towards the viewer, so they aren't hidden by the faces
+    auto vs = [](Vec position, const Uniforms& uniforms) {
+        Vec result = uniforms.mvp * position;
+        result.z += 0.002f;
+        return result;
+    };
+
+    auto fs = [](const Fragment&, const Uniforms&) {
+        return Color::white();
     };
 
-    auto fs = [](Vec) {
-        return Color::blue();
+    auto uniforms = Uniforms::from_model(transform.get_world(), Mat::identity());
+    ras.set_polygon_mode(PolygonMode::Line);
+    ras.set_antialiasing(true);
+    ras.render_vertex_buffer(vertices, uniforms, vs, fs);
+    ras.set_polygon_mode(PolygonMode::Fill);
+    ras.set_antialiasing(false);
+}
+
+// normal of the triangle every vertex belongs to
+[[nodiscard]] std::vector<Vec> compute_face_normals(std::span<const Vec> vertices) {
+    std::vector<Vec> normals;
+    normals.reserve(vertices.size());
+
+    for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+        Vec normal = (vertices[i+1] - vertices[i]).cross(vertices[i+2] - vertices[i]);
+        normal.w = 0.0f;
+        normal = normal.length() > 0.0f ? normal.normalized() : Vec {};
+        normals.insert(normals.end(), 3, normal);
+    }
+
+    return normals;
+}
+
+// grid of models of which only the first one is animated, in retained mode
+// only the tiles around it are redrawn every frame
+void demo_dashboard(Rasterizer& ras, std::span<const Vec> vertices, const Transform& transform) {
+
+    auto fs = [](const Fragment& fragment, const Uniforms&) {
+        float shade = (fragment.position.z + 1) / 2;
+        return Color(0x0, static_cast<uint8_t>(0xff * shade), 0x0, 0xff);
     };
 
-    ras.render_vertex_buffer(obj_vertices, vs, fs);
+    CommandBuffer commands;
+    Mat still = Mat::rotate(Vec {1.0f, 1.0f, 0.0f, 1.0f}, deg_to_rad(30)) * Mat::scale({0.2f, 0.2f, 0.2f, 1.0f});
+
+    for (int row = 0; row < 3; ++row) {
+        for (int column = 0; column < 4; ++column) {
+            Mat translation = Mat::translate({ -0.75f + column * 0.5f, 0.66f - row * 0.66f, 0.0f, 1.0f });
+            Mat model = row == 0 && column == 0 ? transform.get_world() : still;
+            auto uniforms = Uniforms::from_model(translation * Mat::scale({0.4f, 0.4f, 0.4f, 1.0f}) * model, Mat::identity());
+            commands.draw(vertices, uniforms, default_vertex_shader, fs);
+        }
+    }
 
+    ras.submit(commands);
+}
+
+// model lit by colored lights circling around it, the framebuffer needs a g-buffer
+void demo_deferred(Rasterizer& ras, std::span<const Vec> vertices, std::span<const Vec> normals,
+                   const Transform& transform) {
+
+    auto mts = [](const Fragment& fragment, const Uniforms& uniforms, FragmentOutputs& outputs) {
+        Vec normal = uniforms.model * fragment.attribute;
+        normal.w = 0.0f;
+        outputs.write(GBuffer::Normal, normal.normalized());
+        outputs.write(GBuffer::Albedo, Color::white());
+        outputs.write<uint8_t>(GBuffer::Material, 0);
+    };
+
+    auto uniforms = Uniforms::from_model(transform.get_world(), Mat::identity());
+    ras.render_vertex_buffer(vertices, uniforms, default_vertex_shader, mts, normals);
+
+    std::array colors { Color::red(), Color::green(), Color::blue(), Color::white() };
+    std::vector<PointLight> lights;
+    float time = rl::GetTime();
+
+    for (int i = 0; i < 16; ++i) {
+        float angle = time + i * 2 * std::numbers::pi_v<float> / 16;
+        Vec position { std::cos(angle) * 0.6f, std::sin(angle * 2) * 0.3f, 0.3f, 1.0f };
+        lights.push_back({ position, colors[i % colors.size()], 1.5f, 0.8f });
+    }
+
+    ras.shade_deferred(lights, Mat::identity(), Color(0x10, 0x10, 0x10, 0xff));
 }
 
 void demo_triangle(Rasterizer& ras) {
@@ -201,28 +1540,57 @@ void demo_triangle(Rasterizer& ras) {
         Vec(0, 0.9, 0, 1),
     };
 
-    auto vs = [](Vec p) {
-        return p;
-    };
-
-    auto fs = [](Vec) {
+    auto fs = [](const Fragment&, const Uniforms&) {
         return Color::white();
     };
 
-    ras.render_vertex_buffer(vertices, vs, fs);
+    ras.render_vertex_buffer(vertices, default_vertex_shader, fs);
+}
+
+[[nodiscard]] ColorBuffer make_checkerboard(int size, int squares) {
+    ColorBuffer image(size, size);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            bool white = (x * squares / size + y * squares / size) % 2 == 0;
+            image.write(x, y, white ? Color::white() : Color::red());
+        }
+    }
+    return image;
 }
 
-void demo_cube(Rasterizer& ras) {
+void demo_texture(Rasterizer& ras, const Texture& texture, const Transform& transform) {
 
-    auto vs = [](Vec p) {
-        float s = 0.2;
-        auto scale = Mat::scale({s, s, s, 1});
-        auto angle = fmodf((rl::GetTime() * 30), 360);
-        auto rot = Mat::rotate(Vec {1.0f, 1.0f, 0.0f, 1.0f}, deg_to_rad(angle));
-        return rot * scale * p;
+    std::array vertices {
+        Vec(-2, -2, 0, 1),
+        Vec( 2, -2, 0, 1),
+        Vec( 2,  2, 0, 1),
+        Vec( 2,  2, 0, 1),
+        Vec(-2,  2, 0, 1),
+        Vec(-2, -2, 0, 1),
+    };
+
+    // texture coordinates, repeating the texture 4 times along each axis
+    std::array texcoords {
+        Vec(0, 0, 0, 0),
+        Vec(4, 0, 0, 0),
+        Vec(4, 4, 0, 0),
+        Vec(4, 4, 0, 0),
+        Vec(0, 4, 0, 0),
+        Vec(0, 0, 0, 0),
     };
 
-    auto fs = [](Vec) {
+    auto fs = [](const Fragment& fragment, const Uniforms& uniforms) {
+        return uniforms.texture->sample(fragment.attribute, fragment.attribute_dx, fragment.attribute_dy);
+    };
+
+    auto uniforms = Uniforms::from_model(transform.get_world(), Mat::identity());
+    uniforms.texture = &texture;
+    ras.render_vertex_buffer(vertices, uniforms, default_vertex_shader, fs, texcoords);
+}
+
+void demo_cube(Rasterizer& ras, const Transform& transform) {
+
+    auto fs = [](const Fragment&, const Uniforms&) {
         return Color::white();
     };
 
@@ -278,7 +1646,95 @@ void demo_cube(Rasterizer& ras) {
 
     };
 
-    ras.render_vertex_buffer(cube_vertices, vs, fs);
+    auto uniforms = Uniforms::from_model(transform.get_world(), Mat::identity());
+    ras.render_vertex_buffer(cube_vertices, uniforms, default_vertex_shader, fs);
+}
+
+// grid of teapots, most of them outside of the view
+class SceneDemo {
+    static constexpr int grid_size = 20;
+    static constexpr float spacing = 0.4f;
+
+    Mesh m_teapot;
+    Transform m_root;
+    std::vector<std::unique_ptr<Transform>> m_transforms;
+    Scene m_scene;
+
+public:
+    explicit SceneDemo(const char* filename) : m_teapot(load_obj(filename)) {
+
+        generate_lods(m_teapot, 5);
+
+        auto fs = [](const Fragment& fragment, const Uniforms&) {
+            float shade = (fragment.position.z + 1) / 2;
+            return Color(0x0, 0x0, static_cast<uint8_t>(0xff * shade), 0xff);
+        };
+
+        for (int x = 0; x < grid_size; ++x) {
+            for (int y = 0; y < grid_size; ++y) {
+                float s = 0.05;
+                Vec offset {
+                    (x - grid_size / 4) * spacing,
+                    (y - grid_size / 4) * spacing,
+                    0.0f,
+                    1.0f
+                };
+
+                auto& transform = m_transforms.emplace_back(
+                    std::make_unique<Transform>(Mat::translate(offset) * Mat::scale({s, s, s, 1})));
+                transform->set_parent(&m_root);
+                m_scene.add_instance(m_teapot, *transform, fs);
+            }
+        }
+    }
+
+    void render(Rasterizer& ras) {
+        float offset = std::sin(rl::GetTime()) * 0.5f;
+        m_root.set_local(Mat::translate({offset, 0.0f, 0.0f, 1.0f}));
+        m_root.update();
+        m_scene.update();
+        m_scene.render(ras, Mat::identity());
+    }
+
+};
+
+// time from publishing a rendered frame until the consumer sees it
+void benchmark_frame_export(std::span<const Vec> vertices) {
+
+    SharedFrameRing ring(1600, 900);
+    Framebuffer fb(ring.get_width(), ring.get_height());
+    Rasterizer ras(fb);
+    Transform model;
+
+    constexpr int frame_count = 200;
+    std::vector<int64_t> latencies;
+    latencies.reserve(frame_count);
+
+    {
+        FrameConsumer consumer(ring.get_fd(), [&](const SharedFrameRing::Frame& frame) {
+            auto now = std::chrono::steady_clock::now().time_since_epoch();
+            latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() - frame.publish_time);
+        });
+
+        for (int i = 0; i < frame_count; ++i) {
+            std::span<Color> pixels;
+            while ((pixels = ring.begin_frame()).empty()) {
+                std::this_thread::yield();
+            }
+            fb.get_color_buffer().set_storage(pixels);
+            fb.clear();
+            model.set_local(Mat::rotate(Vec {1.0f, 1.0f, 0.0f, 1.0f}, deg_to_rad(i)) * Mat::scale({0.2f, 0.2f, 0.2f, 1.0f}));
+            model.update();
+            demo_obj(ras, vertices, model);
+            ring.end_frame();
+        }
+    }
+
+    std::ranges::sort(latencies);
+    std::println("frame export latency: median {:.1f} us, 99th percentile {:.1f} us, max {:.1f} us",
+                 latencies[latencies.size() / 2] / 1000.0,
+                 latencies[latencies.size() * 99 / 100] / 1000.0,
+                 latencies.back() / 1000.0);
 }
 
 } // namespace
@@ -287,28 +1743,73 @@ int main() {
 
     test();
 
-    Framebuffer fb(1600, 900);
+    if (std::getenv("TDRF_BENCHMARK_EXPORT")) {
+        benchmark_frame_export(load_obj("assets/teapot.obj"));
+        return 0;
+    }
+
+    JobSystem jobs;
+    Framebuffer fb(1600, 900, GBuffer::formats);
     Rasterizer ras(fb);
+    ras.set_job_system(&jobs);
+    // only draws of triangles can be retained, see Rasterizer::set_retained()
+    // ras.set_retained(true);
+
+    // the scene is rendered to a part of the framebuffer, which shrinks when
+    // frames get too slow, and is then scaled up to the window
+    ColorBuffer output(1600, 900);
+    ResolutionController resolution(fb.get_width(), fb.get_height(), 1.0f / 60.0f);
 
     write_to_ppm("out.ppm", fb);
 
     rl::SetConfigFlags(rl::FLAG_WINDOW_RESIZABLE);
     rl::InitWindow(1600, 900, "tdrf");
 
+    auto teapot = load_obj("assets/teapot.obj");
+    auto teapot_normals = compute_face_normals(teapot);
+
+    float s = 0.2;
+    Transform root;
+    Transform model(Mat::scale({s, s, s, 1}));
+    model.set_parent(&root);
+
+    // SceneDemo scene_demo("assets/teapot.obj");
+    // Texture checkerboard(make_checkerboard(256, 8));
+
     while (!rl::WindowShouldClose()) {
         rl::BeginDrawing();
         rl::ClearBackground(rl::BLACK);
 
-        fb.clear();
+        double render_start = rl::GetTime();
+        ras.set_viewport(resolution.get_width(), resolution.get_height());
+
+        // retained mode redraws the changed tiles by itself
+        if (!ras.is_retained()) {
+            fb.clear_viewport(ras.get_viewport_width(), ras.get_viewport_height());
+        }
+        ras.begin_frame();
 
         // TODO: look at matrix
         // TODO: projection matrix (ortho/persp)
 
-        demo_obj(ras, "assets/teapot.obj");
+        auto angle = fmodf((rl::GetTime() * 30), 360);
+        root.set_local(Mat::rotate(Vec {1.0f, 1.0f, 0.0f, 1.0f}, deg_to_rad(angle)));
+        root.update();
+
+        demo_obj(ras, teapot, model);
+        // demo_wireframe(ras, teapot, model);
+        // demo_deferred(ras, teapot, teapot_normals, model);
+        // demo_dashboard(ras, teapot, model);
         // demo_triangle(ras);
-        // demo_cube(ras);
+        // demo_cube(ras, model);
+        // scene_demo.render(ras);
+        // demo_texture(ras, checkerboard, model);
+        ras.end_frame();
+
+        upscale_bilinear(fb.get_color_buffer(), ras.get_viewport_width(), ras.get_viewport_height(), output, &jobs);
+        resolution.update(rl::GetTime() - render_start);
 
-        draw_framebuffer_raylib(fb);
+        draw_framebuffer_raylib(output);
 
         rl::DrawFPS(0, 0);
 
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// linear allocator for transient data, allocations are never freed individually,
+// but all at once by reset()
+class Arena {
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> m_blocks;
+    // current block, and the offset of the next allocation inside of it
+    size_t m_block = 0;
+    size_t m_offset = 0;
+    size_t m_block_size;
+
+public:
+    explicit Arena(size_t block_size = 1 << 20) : m_block_size(block_size) { }
+
+    [[nodiscard]] void* allocate(size_t size, size_t alignment) {
+        assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+        while (m_block < m_blocks.size()) {
+            Block& block = m_blocks[m_block];
+            auto address = reinterpret_cast<uintptr_t>(block.data.get()) + m_offset;
+            size_t padding = (alignment - address % alignment) % alignment;
+
+            if (m_offset + padding + size <= block.size) {
+                m_offset += padding + size;
+                return block.data.get() + m_offset - size;
+            }
+
+            ++m_block;
+            m_offset = 0;
+        }
+
+        // blocks are aligned for any fundamental type, larger alignments are padded
+        size_t block_size = std::max(m_block_size, size + alignment);
+        m_blocks.push_back({ std::make_unique_for_overwrite<std::byte[]>(block_size), block_size });
+        m_block = m_blocks.size() - 1;
+        m_offset = 0;
+        return allocate(size, alignment);
+    }
+
+    // storage for count objects, which are left uninitialized
+    template <typename T>
+    [[nodiscard]] std::span<T> allocate(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena allocations are never destroyed");
+        if (count == 0) return {};
+        return { static_cast<T*>(allocate(count * sizeof(T), alignof(T))), count };
+    }
+
+    // frees all allocations
+    // if the last frame needed more than one block, they are replaced by a single
+    // block holding all of them, so that a steady state doesn't allocate anymore
+    void reset() {
+        if (m_blocks.size() > 1) {
+            size_t size = 0;
+            for (auto& block : m_blocks) {
+                size += block.size;
+            }
+            m_blocks.clear();
+            m_blocks.push_back({ std::make_unique_for_overwrite<std::byte[]>(size), size });
+        }
+
+        m_block = 0;
+        m_offset = 0;
+    }
+
+    [[nodiscard]] size_t get_capacity() const {
+        size_t size = 0;
+        for (auto& block : m_blocks) {
+            size += block.size;
+        }
+        return size;
+    }
+
+};
+
+// per-frame allocator, with a separate arena for every thread, so that threads
+// can allocate without synchronization
+class FrameArena {
+    std::vector<Arena> m_arenas;
+
+public:
+    explicit FrameArena(size_t thread_count = 1) : m_arenas(thread_count) { }
+
+    [[nodiscard]] size_t get_thread_count() const {
+        return m_arenas.size();
+    }
+
+    // all arenas are reset, as resizing invalidates them
+    void set_thread_count(size_t thread_count) {
+        m_arenas.resize(thread_count);
+        reset();
+    }
+
+    [[nodiscard]] Arena& get(size_t thread_index = 0) {
+        return m_arenas[thread_index];
+    }
+
+    void reset() {
+        for (auto& arena : m_arenas) {
+            arena.reset();
+        }
+    }
+
+    // memory of the arenas of all threads, which only grows while frames need more
+    [[nodiscard]] size_t get_capacity() const {
+        size_t size = 0;
+        for (auto& arena : m_arenas) {
+            size += arena.get_capacity();
+        }
+        return size;
+    }
+
+};
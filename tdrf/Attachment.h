@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <variant>
+
+#include "Buffer.h"
+#include "Color.h"
+#include "Half.h"
+#include "Vec.h"
+
+// pixel formats of framebuffer attachments
+enum class Format {
+    // 8-bit color, stored as Color
+    RGBA8,
+    // 16-bit float vectors (e.g. normals, motion vectors), stored as Half4
+    RGBA16F,
+    // stored as float
+    R32F,
+    // 32-bit integers (e.g. picking ids), stored as uint32_t
+    R32UI,
+    // 8-bit integers (e.g. material ids, masks), stored as uint8_t
+    R8,
+};
+
+// additional render target of a framebuffer, the pixels of every attachment are
+// stored contiguously, row by row
+class Attachment {
+    Format m_format;
+    std::variant<Buffer<Color>, Buffer<Half4>, Buffer<float>, Buffer<uint32_t>, Buffer<uint8_t>> m_buffer;
+
+public:
+    Attachment(Format format, int width, int height)
+        : m_format(format)
+        , m_buffer(make_buffer(format, width, height))
+    { }
+
+    [[nodiscard]] Format get_format() const {
+        return m_format;
+    }
+
+    // the type has to match the storage of the format
+    template <typename T>
+    [[nodiscard]] Buffer<T>& get() {
+        assert(std::holds_alternative<Buffer<T>>(m_buffer));
+        return *std::get_if<Buffer<T>>(&m_buffer);
+    }
+
+    template <typename T>
+    [[nodiscard]] const Buffer<T>& get() const {
+        assert(std::holds_alternative<Buffer<T>>(m_buffer));
+        return *std::get_if<Buffer<T>>(&m_buffer);
+    }
+
+    template <typename T>
+    void write(int x, int y, T value) {
+        get<T>().write(x, y, value);
+    }
+
+    // vectors are converted to 16-bit floats
+    void write(int x, int y, Vec value) {
+        get<Half4>().write(x, y, Half4::from_vec(value));
+    }
+
+    // sets every pixel to zero
+    void clear() {
+        std::visit([](auto& buffer) { buffer.clear({}); }, m_buffer);
+    }
+
+    void clear(int min_x, int min_y, int max_x, int max_y) {
+        std::visit([&](auto& buffer) { buffer.clear({}, min_x, min_y, max_x, max_y); }, m_buffer);
+    }
+
+private:
+    [[nodiscard]] static decltype(m_buffer) make_buffer(Format format, int width, int height) {
+        switch (format) {
+            using enum Format;
+            case RGBA8: return Buffer<Color>(width, height);
+            case RGBA16F: return Buffer<Half4>(width, height);
+            case R32F: return Buffer<float>(width, height);
+            case R32UI: return Buffer<uint32_t>(width, height);
+            case R8: return Buffer<uint8_t>(width, height);
+            default: assert(!"invalid format");
+        }
+        return Buffer<uint8_t>(width, height);
+    }
+
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <span>
+
+#include "Vec.h"
+#include "Mat.h"
+
+// axis aligned bounding box, the w component of min and max is unused
+struct Aabb {
+    Vec min {
+        std::numeric_limits<float>::max(),
+        std::numeric_limits<float>::max(),
+        std::numeric_limits<float>::max(),
+        1.0f
+    };
+    Vec max {
+        std::numeric_limits<float>::lowest(),
+        std::numeric_limits<float>::lowest(),
+        std::numeric_limits<float>::lowest(),
+        1.0f
+    };
+
+    [[nodiscard]] static Aabb from_points(std::span<const Vec> points) {
+        Aabb aabb;
+        for (auto& p : points) {
+            aabb.extend(p);
+        }
+        return aabb;
+    }
+
+    [[nodiscard]] constexpr bool is_empty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    constexpr void extend(Vec p) {
+        min = { std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z), 1.0f };
+        max = { std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z), 1.0f };
+    }
+
+    constexpr void extend(const Aabb& other) {
+        extend(other.min);
+        extend(other.max);
+    }
+
+    [[nodiscard]] constexpr Vec center() const {
+        return (min + max) * 0.5f;
+    }
+
+    [[nodiscard]] constexpr Vec extent() const {
+        Vec e = max - min;
+        e.w = 0.0f;
+        return e;
+    }
+
+    [[nodiscard]] constexpr float surface_area() const {
+        if (is_empty()) return 0.0f;
+        Vec e = extent();
+        return 2.0f * (e.x*e.y + e.y*e.z + e.z*e.x);
+    }
+
+    // returns the bounds of this box after transforming it by an affine matrix
+    [[nodiscard]] constexpr Aabb transformed(Mat m) const {
+        // Arvo's method: accumulate the min/max contribution of every matrix element
+        Aabb result;
+        result.min = m.m[3];
+        result.max = m.m[3];
+
+        for (int col = 0; col < 3; ++col) {
+            for (int row = 0; row < 3; ++row) {
+                float a = m.m[col][row] * min[col];
+                float b = m.m[col][row] * max[col];
+                result.min[row] += std::min(a, b);
+                result.max[row] += std::max(a, b);
+            }
+        }
+
+        result.min.w = 1.0f;
+        result.max.w = 1.0f;
+        return result;
+    }
+
+};
+
+struct Sphere {
+    Vec center { 0.0f, 0.0f, 0.0f, 1.0f };
+    float radius = 0.0f;
+
+    // bounding sphere around the center of the points, not necessarily minimal
+    [[nodiscard]] static Sphere from_points(std::span<const Vec> points) {
+        Sphere sphere;
+        sphere.center = Aabb::from_points(points).center();
+        for (auto& p : points) {
+            Vec d = p - sphere.center;
+            sphere.radius = std::max(sphere.radius, d.length());
+        }
+        return sphere;
+    }
+
+    // returns the bounds of this sphere after transforming it by an affine matrix,
+    // non-uniform scaling is accounted for by using the largest scale factor
+    [[nodiscard]] constexpr Sphere transformed(Mat m) const {
+        Vec x = m.m[0], y = m.m[1], z = m.m[2];
+        x.w = y.w = z.w = 0.0f;
+        float scale = std::max({ x.length(), y.length(), z.length() });
+        return { m * center, radius * scale };
+    }
+
+    // approximate amount of pixels covered by a sphere transformed to clip space
+    // by a model-view-projection matrix
+    [[nodiscard]] float get_projected_area(int viewport_width, int viewport_height) const {
+        float w = std::abs(center.w);
+        if (w == 0.0f) return std::numeric_limits<float>::max();
+
+        // radius in NDC, scaled to pixels along both axes
+        float radius_ndc = radius / w;
+        float radius_x = radius_ndc * viewport_width / 2.0f;
+        float radius_y = radius_ndc * viewport_height / 2.0f;
+        return std::numbers::pi_v<float> * radius_x * radius_y;
+    }
+
+    [[nodiscard]] constexpr bool intersects(const Aabb& aabb) const {
+        // squared distance from the center to the closest point of the box
+        float distance = 0.0f;
+        for (int i = 0; i < 3; ++i) {
+            float d = std::clamp(center[i], aabb.min[i], aabb.max[i]) - center[i];
+            distance += d * d;
+        }
+        return distance <= radius * radius;
+    }
+
+};
+
+// view frustum planes, extracted from a view-projection matrix
+// a point p is inside of a plane if plane.x*p.x + plane.y*p.y + plane.z*p.z + plane.w >= 0
+class Frustum {
+    std::array<Vec, 6> m_planes;
+
+public:
+    explicit Frustum(Mat view_projection) {
+        Vec row0 = view_projection.get_row(0);
+        Vec row1 = view_projection.get_row(1);
+        Vec row2 = view_projection.get_row(2);
+        Vec row3 = view_projection.get_row(3);
+
+        m_planes = {
+            row3 + row0, // left
+            row3 - row0, // right
+            row3 + row1, // bottom
+            row3 - row1, // top
+            row3 + row2, // near
+            row3 - row2, // far
+        };
+
+        for (auto& plane : m_planes) {
+            float length = Vec { plane.x, plane.y, plane.z, 0.0f }.length();
+            plane = plane / length;
+        }
+    }
+
+    [[nodiscard]] const std::array<Vec, 6>& get_planes() const {
+        return m_planes;
+    }
+
+    enum class Intersection { Outside, Intersecting, Inside };
+
+    [[nodiscard]] Intersection test(const Aabb& aabb) const {
+        auto result = Intersection::Inside;
+
+        for (auto& plane : m_planes) {
+            // the corners of the box which are furthest along and against the plane normal
+            Vec positive {
+                plane.x >= 0 ? aabb.max.x : aabb.min.x,
+                plane.y >= 0 ? aabb.max.y : aabb.min.y,
+                plane.z >= 0 ? aabb.max.z : aabb.min.z,
+                1.0f
+            };
+            Vec negative {
+                plane.x >= 0 ? aabb.min.x : aabb.max.x,
+                plane.y >= 0 ? aabb.min.y : aabb.max.y,
+                plane.z >= 0 ? aabb.min.z : aabb.max.z,
+                1.0f
+            };
+
+            if (plane * positive < 0) return Intersection::Outside;
+            if (plane * negative < 0) result = Intersection::Intersecting;
+        }
+
+        return result;
+    }
+
+    [[nodiscard]] bool is_visible(const Sphere& sphere) const {
+        for (auto& plane : m_planes) {
+            if (plane * sphere.center < -sphere.radius) return false;
+        }
+        return true;
+    }
+
+};
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <span>
 #include <vector>
 
 #include "Color.h"
@@ -8,15 +12,37 @@ template <typename T>
 class Buffer {
     const int m_width;
     const int m_height;
-    std::vector<T> m_buffer;
+    // empty while the pixels are stored outside of the buffer
+    std::vector<T> m_storage;
+    std::span<T> m_buffer;
 
 public:
     Buffer(int width, int height)
         : m_width(width)
         , m_height(height)
-        , m_buffer(m_width * m_height)
+        , m_storage(m_width * m_height)
+        , m_buffer(m_storage)
     { }
 
+    // copies always own their pixels
+    Buffer(const Buffer& other)
+        : m_width(other.m_width)
+        , m_height(other.m_height)
+        , m_storage(other.m_buffer.begin(), other.m_buffer.end())
+        , m_buffer(m_storage)
+    { }
+
+    // the span keeps pointing to the moved pixels
+    Buffer(Buffer&&) = default;
+
+    // moves the pixels to memory owned by the caller (e.g. shared memory),
+    // which has to outlive the buffer, the previous pixels are discarded
+    void set_storage(std::span<T> storage) {
+        assert(storage.size() == static_cast<size_t>(m_width * m_height));
+        m_storage = {};
+        m_buffer = storage;
+    }
+
     void write(int x, int y, T value) {
         m_buffer[y * m_width + x] = value;
     }
@@ -26,13 +52,25 @@ public:
     }
 
     void clear(T value) {
-        for (int x = 0; x < get_width(); ++x) {
-            for (int y = 0; y < get_height(); ++y) {
-                write(x, y, value);
-            }
+        std::ranges::fill(m_buffer, value);
+    }
+
+    // clears the pixels from (min_x, min_y) up to and including (max_x, max_y)
+    void clear(T value, int min_x, int min_y, int max_x, int max_y) {
+        for (int y = min_y; y <= max_y; ++y) {
+            std::ranges::fill(std::span(m_buffer).subspan(y * m_width + min_x, max_x - min_x + 1), value);
         }
     }
 
+    // all values, row by row
+    [[nodiscard]] std::span<T> get_data() {
+        return m_buffer;
+    }
+
+    [[nodiscard]] std::span<const T> get_data() const {
+        return m_buffer;
+    }
+
     [[nodiscard]] int get_width() const {
         return m_width;
     }
@@ -43,5 +81,13 @@ public:
 
 };
 
+// depth and stencil of a pixel are stored next to each other, so the early
+// test touches a single cache line
+struct alignas(8) DepthStencil {
+    float depth;
+    uint8_t stencil;
+};
+
 using ColorBuffer = Buffer<Color>;
 using DepthBuffer = Buffer<float>;
+using DepthStencilBuffer = Buffer<DepthStencil>;
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Vec.h"
+#include "Mesh.h"
+#include "VertexFormat.h"
+#include "math.h"
+#include "types.h"
+
+// recorded draw, the referenced vertex data has to stay alive until the
+// command buffer has been submitted
+struct DrawCommand {
+    std::span<const Vec> vertices;
+    // empty for non-indexed draws
+    std::span<const uint32_t> indices;
+    std::span<const Vec> attributes;
+    Uniforms uniforms;
+    VertexShader* vs;
+    FragmentStage fs;
+    PipelineState state;
+    // mesh and model matrices of instanced draws, every instance is drawn with the
+    // model matrix of the uniforms replaced by its own, empty for regular draws
+    const Mesh* mesh = nullptr;
+    std::span<const Mat> instances;
+    // vertices and attributes of draws of quantized vertices, which leave both spans empty
+    const QuantizedVertices* quantized = nullptr;
+
+    [[nodiscard]] size_t get_vertex_count() const {
+        return quantized ? quantized->size() : vertices.size();
+    }
+
+    [[nodiscard]] size_t get_index_count() const {
+        return indices.empty() ? get_vertex_count() : indices.size();
+    }
+
+    // identifies the draw across frames, vertex data is identified by its address,
+    // while uniforms and state are compared by value
+    // the model matrices of instanced draws are not included, they are hashed per instance
+    [[nodiscard]] uint64_t get_hash() const {
+        uint64_t hash = 0;
+        auto add = [&](uint64_t value) {
+            hash = hash_combine(hash, value);
+        };
+        auto add_pointer = [&](const void* pointer) {
+            add(std::bit_cast<uintptr_t>(pointer));
+        };
+
+        add_pointer(vertices.data());
+        add(vertices.size());
+        add_pointer(indices.data());
+        add(indices.size());
+        add_pointer(attributes.data());
+        add(attributes.size());
+
+        hash = hash_matrix(hash, uniforms.model);
+        hash = hash_matrix(hash, uniforms.view_projection);
+        hash = hash_matrix(hash, uniforms.mvp);
+        add_pointer(uniforms.texture);
+
+        add_pointer(reinterpret_cast<const void*>(vs));
+        add_pointer(reinterpret_cast<const void*>(fs.fs));
+        add_pointer(reinterpret_cast<const void*>(fs.mts));
+
+        add(static_cast<uint64_t>(state.winding_order));
+        add(static_cast<uint64_t>(state.cull_mode));
+        add(static_cast<uint64_t>(state.polygon_mode));
+        add(state.antialiasing);
+        add(state.stencil.enabled);
+        add(static_cast<uint64_t>(state.stencil.compare));
+        add(static_cast<uint64_t>(state.stencil.fail_op));
+        add(static_cast<uint64_t>(state.stencil.depth_fail_op));
+        add(static_cast<uint64_t>(state.stencil.pass_op));
+        add(state.stencil.reference);
+        add(state.stencil.read_mask);
+        add(state.stencil.write_mask);
+        add(state.depth_test);
+        add(state.depth_write);
+        add(state.color_write);
+        add(state.blending);
+        add(state.transparent);
+        add_pointer(mesh);
+        add_pointer(quantized);
+
+        return hash;
+    }
+
+    [[nodiscard]] static uint64_t hash_matrix(uint64_t hash, const Mat& matrix) {
+        for (auto word : std::bit_cast<std::array<uint32_t, 16>>(matrix)) {
+            hash = hash_combine(hash, word);
+        }
+        return hash;
+    }
+};
+
+// list of draws, which are recorded now and rendered later by Rasterizer::submit()
+// command buffers are not synchronized, every recording thread should use its own
+class CommandBuffer {
+    std::vector<DrawCommand> m_commands;
+    PipelineState m_state;
+
+public:
+    [[nodiscard]] std::span<const DrawCommand> get_commands() const {
+        return m_commands;
+    }
+
+    [[nodiscard]] PipelineState get_state() const {
+        return m_state;
+    }
+
+    // amount of draws that can be recorded without allocating
+    [[nodiscard]] size_t get_capacity() const {
+        return m_commands.capacity();
+    }
+
+    // state used by all subsequently recorded draws
+    void set_state(PipelineState state) {
+        m_state = state;
+    }
+
+    void set_cull_mode(CullMode cull_mode) {
+        m_state.cull_mode = cull_mode;
+    }
+
+    void set_winding_order(WindingOrder winding_order) {
+        m_state.winding_order = winding_order;
+    }
+
+    void set_polygon_mode(PolygonMode polygon_mode) {
+        m_state.polygon_mode = polygon_mode;
+    }
+
+    void set_antialiasing(bool antialiasing) {
+        m_state.antialiasing = antialiasing;
+    }
+
+    void set_stencil(StencilState stencil) {
+        m_state.stencil = stencil;
+    }
+
+    void set_depth_test(bool depth_test) {
+        m_state.depth_test = depth_test;
+    }
+
+    void set_depth_write(bool depth_write) {
+        m_state.depth_write = depth_write;
+    }
+
+    void set_color_write(bool color_write) {
+        m_state.color_write = color_write;
+    }
+
+    void set_blending(bool blending) {
+        m_state.blending = blending;
+    }
+
+    // transparent draws need a fragment shader returning a color
+    void set_transparent(bool transparent) {
+        m_state.transparent = transparent;
+    }
+
+    void draw(std::span<const Vec> vertices, const Uniforms& uniforms, VertexShader vs,
+              FragmentShader fs, std::span<const Vec> attributes = {}) {
+        m_commands.push_back({ vertices, {}, attributes, uniforms, vs, fs, m_state, nullptr, {}, nullptr });
+    }
+
+    void draw(std::span<const Vec> vertices, const Uniforms& uniforms, VertexShader vs,
+              MultiTargetShader mts, std::span<const Vec> attributes = {}) {
+        m_commands.push_back({ vertices, {}, attributes, uniforms, vs, mts, m_state, nullptr, {}, nullptr });
+    }
+
+    void draw_indexed(std::span<const Vec> vertices, std::span<const uint32_t> indices,
+                      const Uniforms& uniforms, VertexShader vs, FragmentShader fs,
+                      std::span<const Vec> attributes = {}) {
+        m_commands.push_back({ vertices, indices, attributes, uniforms, vs, fs, m_state, nullptr, {}, nullptr });
+    }
+
+    void draw_indexed(std::span<const Vec> vertices, std::span<const uint32_t> indices,
+                      const Uniforms& uniforms, VertexShader vs, MultiTargetShader mts,
+                      std::span<const Vec> attributes = {}) {
+        m_commands.push_back({ vertices, indices, attributes, uniforms, vs, mts, m_state, nullptr, {}, nullptr });
+    }
+
+    // the vertices are decoded while they are processed, their attributes are
+    // passed to the fragment shader
+    // the quantized vertices have to stay alive until the command buffer has been submitted
+    // with the default vertex shader, the decoding is folded into the matrix, which
+    // rounds differently than decoding the positions first, so the depths only match
+    // those of the decoded vertices (e.g. a depth pre-pass) within a few ulps, and
+    // passes relying on equal depths need another vertex shader
+    void draw_indexed(const QuantizedVertices& vertices, std::span<const uint32_t> indices,
+                      const Uniforms& uniforms, VertexShader vs, FragmentShader fs) {
+        m_commands.push_back({ {}, indices, {}, uniforms, vs, fs, m_state, nullptr, {}, &vertices });
+    }
+
+    void draw_indexed(const QuantizedVertices& vertices, std::span<const uint32_t> indices,
+                      const Uniforms& uniforms, VertexShader vs, MultiTargetShader mts) {
+        m_commands.push_back({ {}, indices, {}, uniforms, vs, mts, m_state, nullptr, {}, &vertices });
+    }
+
+    // draws the mesh once for every model matrix, the view projection of the
+    // uniforms is shared by all instances
+    // instances outside of the view frustum are culled as a whole, and instances
+    // covering few pixels use a coarser level of detail of the mesh, if it has any
+    // the mesh and the model matrices have to stay alive until the command buffer has been submitted
+    void draw_instanced(const Mesh& mesh, std::span<const Mat> instances, const Uniforms& uniforms,
+                        VertexShader vs, FragmentShader fs) {
+        m_commands.push_back({ mesh.vertices, {}, {}, uniforms, vs, fs, m_state, &mesh, instances, nullptr });
+    }
+
+    void draw_instanced(const Mesh& mesh, std::span<const Mat> instances, const Uniforms& uniforms,
+                        VertexShader vs, MultiTargetShader mts) {
+        m_commands.push_back({ mesh.vertices, {}, {}, uniforms, vs, mts, m_state, &mesh, instances, nullptr });
+    }
+
+    // records the draws of the other command buffer after the ones of this one,
+    // with their own state
+    void append(const CommandBuffer& other) {
+        m_commands.insert(m_commands.end(), other.m_commands.begin(), other.m_commands.end());
+    }
+
+    // removes all recorded draws, keeping the allocated memory
+    void reset() {
+        m_commands.clear();
+        m_state = {};
+    }
+
+};
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "DynamicResolution.h"
+#include "simd.h"
+
+void ResolutionController::update(float frame_time) {
+
+    m_frame_time = m_frame_time == 0.0f
+        ? frame_time
+        : m_frame_time + (frame_time - m_frame_time) * smoothing;
+
+    // the frame time is roughly proportional to the amount of pixels, which
+    // grows with the square of the scale
+    float ratio = m_target_frame_time / m_frame_time;
+    if (std::abs(ratio - 1.0f) < tolerance) return;
+
+    float step = std::clamp(std::sqrt(ratio), 1.0f - max_step, 1.0f + max_step);
+    float scale = std::clamp(m_scale * step, m_min_scale, 1.0f);
+
+    // the average is adjusted to the expected frame time at the new scale, so
+    // frames rendered before the change don't push the scale any further
+    m_frame_time *= (scale * scale) / (m_scale * m_scale);
+    m_scale = scale;
+}
+
+void upscale_bilinear(const ColorBuffer& source, int width, int height, ColorBuffer& target,
+                      JobSystem* job_system) {
+
+    assert(width > 0 && width <= source.get_width());
+    assert(height > 0 && height <= source.get_height());
+
+    auto pixels = source.get_data();
+    auto target_pixels = target.get_data();
+    int source_stride = source.get_width();
+    int target_width = target.get_width();
+    int target_height = target.get_height();
+
+    // coordinates are in 16.16 fixed point, and the weights are their 8 most
+    // significant fractional bits, so that all 4 channels of a pixel are
+    // filtered at once in 16 bit lanes without overflowing
+    constexpr int fraction_bits = 16;
+    constexpr int weight_bits = 8;
+    constexpr uint16_t weight_one = 1 << weight_bits;
+    constexpr int32_t half = 1 << (fraction_bits - 1);
+
+    // size of a target pixel in source pixels
+    int32_t step_x = (static_cast<int64_t>(width) << fraction_bits) / target_width;
+    int32_t step_y = (static_cast<int64_t>(height) << fraction_bits) / target_height;
+
+    // rows are filtered vertically first, in chunks of source pixels, which are
+    // then filtered horizontally for all target pixels between them, every
+    // source pixel is only filtered vertically once per row, even when upscaling
+    constexpr int chunk_size = 256;
+
+    auto upscale_rows = [&](size_t begin, size_t end) {
+        // the last pixel is the right neighbor of the last pixel of the chunk
+        std::array<u16x4, chunk_size + 1> columns;
+
+        for (size_t y = begin; y < end; ++y) {
+            auto target_row = target_pixels.subspan(y * target_width, target_width);
+
+            // pixel centers are at half integer coordinates, samples outside of
+            // the source are clamped to its edge
+            int32_t v = std::max(static_cast<int32_t>(y) * step_y + step_y / 2 - half, 0);
+            int y0 = std::min(v >> fraction_bits, height - 1);
+            int y1 = std::min(y0 + 1, height - 1);
+            auto weight_y = static_cast<uint16_t>((v >> (fraction_bits - weight_bits)) & (weight_one - 1));
+            auto weight_y0 = static_cast<uint16_t>(weight_one - weight_y);
+
+            const Color* row0 = pixels.data() + y0 * source_stride;
+            const Color* row1 = pixels.data() + y1 * source_stride;
+
+            int x = 0;
+            int32_t u = step_x / 2 - half;
+
+            for (int chunk = 0; chunk < width; chunk += chunk_size) {
+                int count = std::min(chunk_size + 1, width - chunk);
+
+                // two pixels at a time, in the lower and upper lanes
+                int i = 0;
+                for (; i + 1 < count; i += 2) {
+                    u8x8 top, bottom;
+                    std::memcpy(&top, row0 + chunk + i, sizeof(top));
+                    std::memcpy(&bottom, row1 + chunk + i, sizeof(bottom));
+                    u16x8 column = (__builtin_convertvector(top, u16x8) * weight_y0
+                                  + __builtin_convertvector(bottom, u16x8) * weight_y) >> weight_bits;
+                    std::memcpy(&columns[i], &column, sizeof(column));
+                }
+                if (i < count) {
+                    u16x4 top = __builtin_convertvector(std::bit_cast<u8x4>(row0[chunk + i]), u16x4);
+                    u16x4 bottom = __builtin_convertvector(std::bit_cast<u8x4>(row1[chunk + i]), u16x4);
+                    columns[i] = (top * weight_y0 + bottom * weight_y) >> weight_bits;
+                }
+
+                for (; x < target_width; ++x, u += step_x) {
+                    int32_t clamped = std::max(u, 0);
+                    int index = (clamped >> fraction_bits) - chunk;
+                    if (index >= chunk_size) break;
+
+                    auto weight_x = static_cast<uint16_t>((clamped >> (fraction_bits - weight_bits)) & (weight_one - 1));
+                    u16x4 left = columns[index];
+                    u16x4 right = columns[std::min(index + 1, count - 1)];
+                    u16x4 result = (left * static_cast<uint16_t>(weight_one - weight_x) + right * weight_x) >> weight_bits;
+                    target_row[x] = std::bit_cast<Color>(__builtin_convertvector(result, u8x4));
+                }
+            }
+        }
+    };
+
+    // rows are cheap, so every job filters a few of them
+    constexpr size_t rows_per_job = 16;
+
+    if (job_system) {
+        job_system->parallel_for(target_height, rows_per_job, upscale_rows);
+    } else {
+        upscale_rows(0, target_height);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "Buffer.h"
+#include "JobSystem.h"
+
+// picks the render resolution of the next frame from the time the previous
+// frames took, so that the frame time stays close to a target under varying load
+// the resolution is a fraction of a maximum size, which the framebuffer is
+// allocated with, and is applied with Rasterizer::set_viewport()
+class ResolutionController {
+    const int m_max_width;
+    const int m_max_height;
+    // in seconds
+    const float m_target_frame_time;
+    const float m_min_scale;
+    // fraction of the maximum size along both axes
+    float m_scale = 1.0f;
+    // moving average of the frame times, zero before the first frame
+    float m_frame_time = 0.0f;
+
+    // weight of the newest frame in the average
+    static constexpr float smoothing = 0.2f;
+    // deviations from the target smaller than this are ignored, so the
+    // resolution doesn't change every frame
+    static constexpr float tolerance = 0.05f;
+    // largest relative change of the scale per frame
+    static constexpr float max_step = 0.1f;
+
+public:
+    ResolutionController(int max_width, int max_height, float target_frame_time, float min_scale = 0.5f)
+        : m_max_width(max_width)
+        , m_max_height(max_height)
+        , m_target_frame_time(target_frame_time)
+        , m_min_scale(min_scale)
+    {
+        assert(target_frame_time > 0.0f);
+        assert(min_scale > 0.0f && min_scale <= 1.0f);
+    }
+
+    // frame_time is the time the last frame took to render, at the current resolution
+    void update(float frame_time);
+
+    [[nodiscard]] float get_scale() const {
+        return m_scale;
+    }
+
+    [[nodiscard]] int get_width() const {
+        return std::max(1, static_cast<int>(std::lround(m_max_width * m_scale)));
+    }
+
+    [[nodiscard]] int get_height() const {
+        return std::max(1, static_cast<int>(std::lround(m_max_height * m_scale)));
+    }
+
+};
+
+// scales the top left width x height pixels of the source to the whole target,
+// with bilinear filtering, the rows of the target are filtered in parallel if a
+// job system is given
+void upscale_bilinear(const ColorBuffer& source, int width, int height, ColorBuffer& target,
+                      JobSystem* job_system = nullptr);
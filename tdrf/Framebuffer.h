@@ -1,17 +1,49 @@
 #pragma once
 
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <vector>
+
+#include "Attachment.h"
 #include "Buffer.h"
 
+// attachments of the g-buffer read by Rasterizer::shade_deferred(), which
+// hold the surface of the closest fragment of every pixel, the material is an
+// index into the materials of the lighting pass
+struct GBuffer {
+    enum Slot : size_t { Normal, Albedo, Material };
+    static constexpr std::array formats { Format::RGBA16F, Format::RGBA8, Format::R8 };
+};
+
 class Framebuffer {
     const int m_width;
     const int m_height;
     ColorBuffer m_color_buffer {m_width, m_height};
-    DepthBuffer m_depth_buffer {m_width, m_height};
+    DepthStencilBuffer m_depth_stencil_buffer {m_width, m_height};
+    std::vector<Attachment> m_attachments;
+    // incremented by every clear, marks the start of a new frame
+    uint64_t m_generation = 0;
 
 public:
-    Framebuffer(int width, int height)
+    // depth of pixels no fragment has been written to
+    static constexpr float cleared_depth = -1.0f;
+    static constexpr uint8_t cleared_stencil = 0;
+
+    // attachments are additional render targets, written by multi-target fragment shaders
+    Framebuffer(int width, int height, std::span<const Format> attachments)
         : m_width(width)
         , m_height(height)
+    {
+        for (auto format : attachments) {
+            m_attachments.emplace_back(format, width, height);
+        }
+    }
+
+    Framebuffer(int width, int height, std::initializer_list<Format> attachments = {})
+        : Framebuffer(width, height, std::span(attachments.begin(), attachments.end()))
     { }
 
     [[nodiscard]] int get_width() const {
@@ -30,17 +62,99 @@ public:
         return m_color_buffer;
     }
 
-    [[nodiscard]] DepthBuffer& get_depth_buffer() {
-        return m_depth_buffer;
+    [[nodiscard]] DepthStencilBuffer& get_depth_stencil_buffer() {
+        return m_depth_stencil_buffer;
+    }
+
+    [[nodiscard]] const DepthStencilBuffer& get_depth_stencil_buffer() const {
+        return m_depth_stencil_buffer;
+    }
+
+    [[nodiscard]] float get_depth(int x, int y) const {
+        return m_depth_stencil_buffer.get(x, y).depth;
+    }
+
+    [[nodiscard]] uint8_t get_stencil(int x, int y) const {
+        return m_depth_stencil_buffer.get(x, y).stencil;
+    }
+
+    [[nodiscard]] size_t get_attachment_count() const {
+        return m_attachments.size();
+    }
+
+    [[nodiscard]] Attachment& get_attachment(size_t index) {
+        assert(index < m_attachments.size());
+        return m_attachments[index];
+    }
+
+    [[nodiscard]] const Attachment& get_attachment(size_t index) const {
+        assert(index < m_attachments.size());
+        return m_attachments[index];
+    }
+
+    // checks if the attachments start with the ones of the g-buffer
+    [[nodiscard]] bool has_gbuffer() const {
+        if (m_attachments.size() < GBuffer::formats.size()) return false;
+        for (size_t i = 0; i < GBuffer::formats.size(); ++i) {
+            if (m_attachments[i].get_format() != GBuffer::formats[i]) return false;
+        }
+        return true;
     }
 
-    [[nodiscard]] const DepthBuffer& get_depth_buffer() const {
-        return m_depth_buffer;
+    [[nodiscard]] uint64_t get_generation() const {
+        return m_generation;
     }
 
     void clear() {
         m_color_buffer.clear(Color::black());
-        m_depth_buffer.clear(-1.0f);
+        m_depth_stencil_buffer.clear({ cleared_depth, cleared_stencil });
+        for (auto& attachment : m_attachments) {
+            attachment.clear();
+        }
+        ++m_generation;
+    }
+
+    // starts a new frame like clear(), but only clears the top left width x height
+    // pixels, which are all that a viewport of that size renders to
+    void clear_viewport(int width, int height) {
+        clear(0, 0, width - 1, height - 1);
+        ++m_generation;
+    }
+
+    // clears the pixels of a rectangle, without starting a new frame
+    void clear(int min_x, int min_y, int max_x, int max_y) {
+        m_color_buffer.clear(Color::black(), min_x, min_y, max_x, max_y);
+        m_depth_stencil_buffer.clear({ cleared_depth, cleared_stencil }, min_x, min_y, max_x, max_y);
+        for (auto& attachment : m_attachments) {
+            attachment.clear(min_x, min_y, max_x, max_y);
+        }
+    }
+
+};
+
+// render targets of a single pixel, which are written by multi-target fragment shaders
+class FragmentOutputs {
+    Framebuffer& m_framebuffer;
+    int m_x;
+    int m_y;
+
+public:
+    FragmentOutputs(Framebuffer& framebuffer, int x, int y)
+        : m_framebuffer(framebuffer)
+        , m_x(x)
+        , m_y(y)
+    { }
+
+    // the color is written without blending
+    void write_color(Color color) {
+        m_framebuffer.get_color_buffer().write(m_x, m_y, color);
+    }
+
+    // the type of the value has to match the format of the attachment, vectors
+    // are written to RGBA16F attachments
+    template <typename T>
+    void write(size_t attachment, T value) {
+        m_framebuffer.get_attachment(attachment).write(m_x, m_y, value);
     }
 
 };
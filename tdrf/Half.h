@@ -0,0 +1,83 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+#include "Vec.h"
+
+// 16-bit floating point number, stored as its bit pattern
+struct Half {
+    uint16_t bits = 0;
+
+    // rounds to the nearest representable value, values too large become infinity
+    [[nodiscard]] static constexpr Half from_float(float value) {
+        uint32_t f = std::bit_cast<uint32_t>(value);
+        uint16_t sign = (f >> 16) & 0x8000;
+        uint32_t magnitude = f & 0x7fffffff;
+
+        // nan and infinity
+        if (magnitude >= 0x7f800000) {
+            return { static_cast<uint16_t>(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0)) };
+        }
+
+        // overflows to infinity
+        if (magnitude >= 0x477ff000) {
+            return { static_cast<uint16_t>(sign | 0x7c00) };
+        }
+
+        // subnormal halves, the implicit leading bit is shifted into the mantissa
+        if (magnitude < 0x38800000) {
+            if (magnitude < 0x33000000) return { sign };
+            uint32_t exponent = magnitude >> 23;
+            uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+            uint32_t shift = 126 - exponent;
+            uint32_t half = mantissa >> shift;
+            uint32_t rest = mantissa & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            // round to nearest, ties to even
+            if (rest > halfway || (rest == halfway && (half & 1))) ++half;
+            return { static_cast<uint16_t>(sign | half) };
+        }
+
+        // rebias the exponent from 127 to 15, and round the mantissa to 10 bits
+        uint32_t half = (magnitude - 0x38000000) >> 13;
+        uint32_t rest = magnitude & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) ++half;
+        return { static_cast<uint16_t>(sign | half) };
+    }
+
+    [[nodiscard]] constexpr float to_float() const {
+        uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+        uint32_t exponent = (bits >> 10) & 0x1f;
+        uint32_t mantissa = bits & 0x3ff;
+
+        if (exponent == 0) {
+            // zero and subnormals, which are normal floats
+            float value = mantissa * (1.0f / (1 << 24));
+            return sign ? -value : value;
+        }
+
+        if (exponent == 0x1f) {
+            return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+        }
+
+        return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+    }
+
+    constexpr bool operator==(const Half&) const = default;
+};
+
+// four 16-bit floats, the storage of RGBA16F attachments
+struct Half4 {
+    Half x, y, z, w;
+
+    [[nodiscard]] static constexpr Half4 from_vec(Vec v) {
+        return { Half::from_float(v.x), Half::from_float(v.y), Half::from_float(v.z), Half::from_float(v.w) };
+    }
+
+    [[nodiscard]] constexpr Vec to_vec() const {
+        return { x.to_float(), y.to_float(), z.to_float(), w.to_float() };
+    }
+};
+
+static_assert(sizeof(Half4) == 8);
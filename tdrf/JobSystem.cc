@@ -0,0 +1,160 @@
+#include <cassert>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "JobSystem.h"
+
+namespace {
+
+// job system the calling thread is a worker of, and its index in it
+thread_local const JobSystem* worker_system = nullptr;
+thread_local size_t worker_index = 0;
+
+void pin_to_core(size_t core) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void) core;
+#endif
+}
+
+} // namespace
+
+JobSystem::JobSystem(size_t thread_count, bool pin_threads) {
+
+    thread_count = std::max<size_t>(thread_count, 1);
+
+    for (size_t i = 0; i < thread_count; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+
+    if (pin_threads) {
+        pin_to_core(0);
+    }
+
+    for (size_t i = 1; i < thread_count; ++i) {
+        m_threads.emplace_back(&JobSystem::worker_loop, this, i, pin_threads);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard lock(m_sleep_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+size_t JobSystem::get_thread_index() const {
+    return worker_system == this ? worker_index : 0;
+}
+
+void JobSystem::schedule(const Job& job) {
+
+    job.counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+
+    // threads outside of the job system share the deque of worker 0
+    Worker& worker = *m_workers[get_thread_index()];
+    bool queued = false;
+    {
+        std::lock_guard lock(worker.mutex);
+        if (worker.back - worker.front < deque_capacity) {
+            worker.jobs[worker.back++ % deque_capacity] = job;
+            m_queued.fetch_add(1, std::memory_order_release);
+            queued = true;
+        }
+    }
+
+    if (!queued) {
+        execute(job);
+        return;
+    }
+
+    // the mutex orders the notification after the check of a worker going to sleep
+    if (!m_threads.empty()) {
+        std::lock_guard lock(m_sleep_mutex);
+        m_wake.notify_one();
+    }
+}
+
+void JobSystem::wait(JobCounter& counter) {
+
+    size_t index = get_thread_index();
+
+    while (!counter.is_done()) {
+        Job job;
+        if (pop(index, job) || steal(index, job)) {
+            execute(job);
+        } else {
+            // the remaining jobs are running on other workers
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::worker_loop(size_t index, bool pin_thread) {
+
+    worker_system = this;
+    worker_index = index;
+    if (pin_thread) {
+        pin_to_core(index);
+    }
+
+    while (true) {
+        Job job;
+        if (pop(index, job) || steal(index, job)) {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock lock(m_sleep_mutex);
+        m_wake.wait(lock, [&] {
+            return m_stop || m_queued.load(std::memory_order_acquire) > 0;
+        });
+        if (m_stop) return;
+    }
+}
+
+bool JobSystem::pop(size_t index, Job& job) {
+    Worker& worker = *m_workers[index];
+    std::lock_guard lock(worker.mutex);
+
+    if (worker.front == worker.back) return false;
+
+    // the most recently scheduled job is most likely still in the cache
+    job = worker.jobs[--worker.back % deque_capacity];
+    m_queued.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool JobSystem::steal(size_t index, Job& job) {
+
+    for (size_t i = 1; i < m_workers.size(); ++i) {
+        Worker& victim = *m_workers[(index + i) % m_workers.size()];
+        std::lock_guard lock(victim.mutex);
+
+        if (victim.front == victim.back) continue;
+
+        // the oldest jobs tend to be the largest ones
+        job = victim.jobs[victim.front++ % deque_capacity];
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+void JobSystem::execute(const Job& job) {
+    job.function(job.data, job.begin, job.end);
+    job.counter->m_pending.fetch_sub(1, std::memory_order_acq_rel);
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// tracks the completion of a group of jobs, jobs of a later stage can wait for
+// the counter of the stage they depend on
+class JobCounter {
+    std::atomic<uint32_t> m_pending = 0;
+    friend class JobSystem;
+
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    [[nodiscard]] bool is_done() const {
+        return m_pending.load(std::memory_order_acquire) == 0;
+    }
+
+};
+
+// work-stealing scheduler, every worker owns a deque of jobs, which it works
+// through from the back, while idle workers steal from the front of the others
+// the thread which created the job system takes part as worker 0, while it is
+// waiting for a counter
+class JobSystem {
+public:
+    // jobs run a function on a range of indices, they don't own any data, so
+    // scheduling them never allocates
+    struct Job {
+        void (*function)(void* data, size_t begin, size_t end);
+        void* data;
+        size_t begin;
+        size_t end;
+        JobCounter* counter;
+    };
+
+private:
+    // jobs which don't fit into a full deque are run immediately
+    static constexpr size_t deque_capacity = 1024;
+
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::array<Job, deque_capacity> jobs;
+        // indices of the front and back, growing monotonically
+        size_t front = 0;
+        size_t back = 0;
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    // amount of jobs in all deques, idle workers sleep while it is zero
+    std::atomic<size_t> m_queued = 0;
+    std::atomic<bool> m_stop = false;
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wake;
+
+public:
+    // pinning binds every worker to a core of its own, if the platform supports it
+    explicit JobSystem(size_t thread_count = std::thread::hardware_concurrency(), bool pin_threads = false);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // amount of workers, including the creating thread
+    [[nodiscard]] size_t get_thread_count() const {
+        return m_workers.size();
+    }
+
+    // index of the worker running the calling thread, threads which are not
+    // workers of this job system (e.g. workers of another one) are worker 0
+    [[nodiscard]] size_t get_thread_index() const;
+
+    void schedule(const Job& job);
+
+    // splits the range [0, count) into batches, and schedules a job for each of them
+    // function is called as function(begin, end), and has to stay alive until the
+    // counter is done
+    template <typename F>
+    void parallel_for(size_t count, size_t batch_size, JobCounter& counter, F& function) {
+        auto trampoline = [](void* data, size_t begin, size_t end) {
+            (*static_cast<F*>(data))(begin, end);
+        };
+
+        for (size_t begin = 0; begin < count; begin += batch_size) {
+            schedule({ trampoline, &function, begin, std::min(begin + batch_size, count), &counter });
+        }
+    }
+
+    // blocking version of parallel_for, which returns once all batches are done
+    template <typename F>
+    void parallel_for(size_t count, size_t batch_size, F&& function) {
+        JobCounter counter;
+        parallel_for(count, batch_size, counter, function);
+        wait(counter);
+    }
+
+    // runs jobs until all jobs of the counter are done, the waiting thread helps
+    // out instead of blocking, so jobs can wait for jobs they scheduled themselves
+    void wait(JobCounter& counter);
+
+private:
+    void worker_loop(size_t index, bool pin_thread);
+    [[nodiscard]] bool pop(size_t index, Job& job);
+    [[nodiscard]] bool steal(size_t index, Job& job);
+    static void execute(const Job& job);
+
+};
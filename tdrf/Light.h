@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Color.h"
+#include "Vec.h"
+
+// light emitted from a point, which fades out towards its radius
+struct PointLight {
+    Vec position { 0.0f, 0.0f, 0.0f, 1.0f };
+    Color color = Color::white();
+    float intensity = 1.0f;
+    float radius = 1.0f;
+};
+
+// lighting parameters of the surfaces in the g-buffer, selected by the material
+// id of every pixel
+struct SurfaceMaterial {
+    // scales the light received from point lights
+    float diffuse = 1.0f;
+    // light emitted by the surface itself, relative to its albedo, which also
+    // lights surfaces not reached by any light (e.g. lamps, screens)
+    float emission = 0.0f;
+};
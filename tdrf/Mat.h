@@ -2,6 +2,7 @@
 
 #include <array>
 #include <cmath>
+#include <utility>
 
 #include "Vec.h"
 
@@ -78,11 +79,12 @@ struct Mat {
         Vec row2 = get_row(2);
         Vec row3 = get_row(3);
 
+        // each column of the result is this matrix applied to a column of the other
         return {
-            Vec {row0 * other.m[0], row0 * other.m[1], row0 * other.m[2], row0 * other.m[3] },
-            Vec {row1 * other.m[0], row1 * other.m[1], row1 * other.m[2], row1 * other.m[3] },
-            Vec {row2 * other.m[0], row2 * other.m[1], row2 * other.m[2], row2 * other.m[3] },
-            Vec {row3 * other.m[0], row3 * other.m[1], row3 * other.m[2], row3 * other.m[3] },
+            Vec {row0 * other.m[0], row1 * other.m[0], row2 * other.m[0], row3 * other.m[0] },
+            Vec {row0 * other.m[1], row1 * other.m[1], row2 * other.m[1], row3 * other.m[1] },
+            Vec {row0 * other.m[2], row1 * other.m[2], row2 * other.m[2], row3 * other.m[2] },
+            Vec {row0 * other.m[3], row1 * other.m[3], row2 * other.m[3], row3 * other.m[3] },
         };
     }
 
@@ -213,6 +215,49 @@ struct Mat {
         return m;
     }
 
+    // returns the inverse, the matrix has to be invertible
+    [[nodiscard]] constexpr Mat inverse() const {
+
+        // gauss-jordan elimination with partial pivoting on the rows of [this | identity],
+        // which turns the right half into the inverse
+        std::array<std::array<float, 8>, 4> rows {};
+        for (int row = 0; row < 4; ++row) {
+            for (int col = 0; col < 4; ++col) {
+                rows[row][col] = m[col][row];
+            }
+            rows[row][4 + row] = 1.0f;
+        }
+
+        for (int col = 0; col < 4; ++col) {
+            int pivot = col;
+            for (int row = col + 1; row < 4; ++row) {
+                if (std::abs(rows[row][col]) > std::abs(rows[pivot][col])) pivot = row;
+            }
+            std::swap(rows[col], rows[pivot]);
+
+            float scale = 1.0f / rows[col][col];
+            for (auto& value : rows[col]) {
+                value *= scale;
+            }
+
+            for (int row = 0; row < 4; ++row) {
+                if (row == col) continue;
+                float factor = rows[row][col];
+                for (int i = 0; i < 8; ++i) {
+                    rows[row][i] -= factor * rows[col][i];
+                }
+            }
+        }
+
+        Mat result;
+        for (int row = 0; row < 4; ++row) {
+            for (int col = 0; col < 4; ++col) {
+                result.m[col][row] = rows[row][4 + col];
+            }
+        }
+        return result;
+    }
+
     // returns the nth row as a vector
     [[nodiscard]] constexpr Vec get_row(int n) const {
         return { m[0][n], m[1][n], m[2][n], m[3][n] };
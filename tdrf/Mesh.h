@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Vec.h"
+#include "Bounds.h"
+
+// vertices shared between triangles, every 3 indices form a triangle
+struct IndexedMesh {
+    std::vector<Vec> vertices;
+    std::vector<uint32_t> indices;
+
+    [[nodiscard]] size_t get_triangle_count() const {
+        return indices.size() / 3;
+    }
+};
+
+// triangle list in object space, together with its bounding volumes
+struct Mesh {
+    std::vector<Vec> vertices;
+    Aabb aabb;
+    Sphere sphere;
+    // optional level of detail chain, ordered from the most to the least detailed
+    // level, see generate_lods()
+    std::vector<IndexedMesh> lods;
+
+    Mesh() = default;
+
+    explicit Mesh(std::vector<Vec> vertices)
+        : vertices(std::move(vertices))
+        , aabb(Aabb::from_points(this->vertices))
+        , sphere(Sphere::from_points(this->vertices))
+    { }
+
+    // picks the level of detail for a mesh covering the given amount of pixels
+    // on screen, so that a triangle covers at least pixels_per_triangle pixels on
+    // average, returns nullptr if there are no levels of detail
+    [[nodiscard]] const IndexedMesh* select_lod(float covered_pixels, float pixels_per_triangle) const {
+        if (lods.empty()) return nullptr;
+
+        for (auto& lod : lods) {
+            if (lod.get_triangle_count() * pixels_per_triangle <= covered_pixels) {
+                return &lod;
+            }
+        }
+
+        return &lods.back();
+    }
+
+};
@@ -1,20 +1,799 @@
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+
 #include "Rasterizer.h"
+#include "simd.h"
+#include "Bounds.h"
+
+void Rasterizer::render_triangles(std::span<const Vec> vertices, std::span<const uint32_t> indices,
+                                  const Uniforms& uniforms, VertexShader vs, FragmentStage fs,
+                                  std::span<const Vec> attributes) {
+
+    assert(indices.size() % 3 == 0);
+
+    // transparent fragments are only composited by submissions, and retained
+    // frames only render submissions
+    if (m_state.transparent || m_retained) {
+        assert(!m_state.transparent || fs.fs);
+        m_immediate_commands.reset();
+        m_immediate_commands.set_state(m_state);
+        if (fs.fs) {
+            m_immediate_commands.draw_indexed(vertices, indices, uniforms, vs, fs.fs, attributes);
+        } else {
+            m_immediate_commands.draw_indexed(vertices, indices, uniforms, vs, fs.mts, attributes);
+        }
+        submit(m_immediate_commands);
+        return;
+    }
+
+    if (indices.empty()) {
+        indices = get_sequential_indices(vertices.size());
+    }
+
+    sync_frame_arena();
+    process_draw_vertices(vertices, attributes, uniforms, vs);
+    draw_triangles(indices, uniforms, fs);
+}
+
+void Rasterizer::draw_triangle(Vec a_ndc, Vec b_ndc, Vec c_ndc, const Uniforms& uniforms, VertexShader vs, FragmentShader fs) {
+    // the vertices don't live until the end of a retained frame
+    assert(!m_retained);
+    std::array vertices { a_ndc, b_ndc, c_ndc };
+    render_vertex_buffer(vertices, uniforms, vs, fs);
+}
+
+void Rasterizer::shade_deferred(std::span<const PointLight> lights, const Mat& view_projection, Color ambient,
+                                std::span<const SurfaceMaterial> materials) {
+
+    assert(m_framebuffer.has_gbuffer());
+    // the geometry of a retained frame is only drawn by end_frame()
+    assert(!m_retained || !m_frame_active);
+
+    sync_frame_arena();
+
+    Mat inverse_view_projection = view_projection.inverse();
+    int tiles_x = (m_viewport_width + lighting_tile_size - 1) / lighting_tile_size;
+    int tiles_y = (m_viewport_height + lighting_tile_size - 1) / lighting_tile_size;
+
+    for_each_batch(tiles_x * tiles_y, 1, [&](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; ++tile) {
+            light_tile(tile, lights, inverse_view_projection, ambient, materials);
+        }
+    });
+}
+
+void Rasterizer::draw_line(Vec a_ndc, Vec b_ndc, const Uniforms& uniforms, VertexShader vs, FragmentShader fs,
+                           std::span<const Vec> attributes) {
+
+    assert(!m_retained);
+    std::array vertices { a_ndc, b_ndc };
+
+    sync_frame_arena();
+    process_draw_vertices(vertices, attributes, uniforms, vs);
+
+    PipelineState state = m_state;
+    state.transparent = false;
+
+    dispatch_raster_features(state, fs, [&]<RasterFeatures features>() {
+        rasterize_line<features>(0, 1, uniforms, fs, get_viewport_bounds(), state);
+    });
+}
+
+void Rasterizer::draw_points(std::span<const Vec> points, const Uniforms& uniforms, VertexShader vs, FragmentShader fs,
+                             std::span<const Vec> attributes) {
+
+    assert(!m_retained);
 
-void Rasterizer::draw_triangle(Vec a_ndc, Vec b_ndc, Vec c_ndc, VertexShader vs, FragmentShader fs) {
+    sync_frame_arena();
+    process_draw_vertices(points, attributes, uniforms, vs);
+
+    PipelineState state = m_state;
+    state.transparent = false;
+
+    dispatch_raster_features(state, fs, [&]<RasterFeatures features>() {
+        for (uint32_t i = 0; i < points.size(); ++i) {
+            rasterize_point<features>(i, uniforms, fs, get_viewport_bounds(), state);
+        }
+    });
+}
+
+void Rasterizer::shade_vertices(std::span<const Vec> vertices, const Uniforms& uniforms, VertexShader vs,
+                                std::span<Vec> vertices_vp, int width, int height) {
+
+    if (vs != default_vertex_shader) {
+        for (size_t i = 0; i < vertices.size(); ++i) {
+            vertices_vp[i] = viewport_transform(vs(vertices[i], uniforms), width, height);
+        }
+        return;
+    }
+
+    // the same sums as Mat::operator*(Vec), accumulated along the columns instead of the rows
+    std::array<f32x4, 4> columns;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        columns[i] = std::bit_cast<f32x4>(uniforms.mvp.m[i]);
+    }
+
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        Vec v = vertices[i];
+        f32x4 position = columns[0] * v.x + columns[1] * v.y + columns[2] * v.z + columns[3] * v.w;
+        vertices_vp[i] = viewport_transform(std::bit_cast<Vec>(position), width, height);
+    }
+}
+
+void Rasterizer::process_vertices(std::span<const Vec> vertices, std::span<const Vec> attributes,
+                                  const Uniforms& uniforms, VertexShader vs, size_t offset) {
+
+    assert(attributes.empty() || attributes.size() == vertices.size());
+    assert(offset + vertices.size() <= m_vertices_vp.size());
 
     // TODO: clip vertices outside of ndc area, and reconstruct triangle
     // TODO: divide by w
+    // TODO: fix z values, they should go from 0.0 to 1.0
 
-    a_ndc = vs(a_ndc);
-    b_ndc = vs(b_ndc);
-    c_ndc = vs(c_ndc);
+    shade_vertices(vertices, uniforms, vs, m_vertices_vp.subspan(offset, vertices.size()),
+                   m_viewport_width, m_viewport_height);
 
-    // TODO: fix z values, they should go from 0.0 to 1.0
-    Vec a_vp = viewport_transform(a_ndc);
-    Vec b_vp = viewport_transform(b_ndc);
-    Vec c_vp = viewport_transform(c_ndc);
+    auto attributes_out = m_attributes.subspan(offset, vertices.size());
+    if (attributes.empty()) {
+        std::ranges::fill(attributes_out, Vec {});
+    } else {
+        std::ranges::copy(attributes, attributes_out.begin());
+    }
+}
+
+size_t Rasterizer::cull_triangles(std::span<const Vec> vertices_vp, std::span<const uint32_t> indices,
+                                  PipelineState state, std::span<uint32_t> visible) {
+
+    assert(indices.size() % 3 == 0);
+    assert(visible.size() >= indices.size() / 3);
+
+    auto [keep_cw, keep_ccw] = get_culling_by_area_sign(state);
+    if (!keep_cw && !keep_ccw) return 0;
+
+    size_t count = indices.size() / 3;
+    size_t visible_count = 0;
+    size_t i = 0;
+
+    // the signed area of 4 triangles at once, degenerate triangles have an area of 0,
+    // and are therefore rejected by both comparisons
+    i32x4 mask_cw = keep_cw ? ~i32x4 {} : i32x4 {};
+    i32x4 mask_ccw = keep_ccw ? ~i32x4 {} : i32x4 {};
+
+    for (; i + 4 <= count; i += 4) {
+        f32x4 ax, ay, bx, by, cx, cy;
+
+        for (int lane = 0; lane < 4; ++lane) {
+            const uint32_t* tri = &indices[(i + lane) * 3];
+            const Vec& a = vertices_vp[tri[0]];
+            const Vec& b = vertices_vp[tri[1]];
+            const Vec& c = vertices_vp[tri[2]];
+            ax[lane] = a.x; ay[lane] = a.y;
+            bx[lane] = b.x; by[lane] = b.y;
+            cx[lane] = c.x; cy[lane] = c.y;
+        }
+
+        f32x4 area = (bx-ax)*(cy-ay) - (by-ay)*(cx-ax);
+        i32x4 keep = ((area > 0.0f) & mask_cw) | ((area < 0.0f) & mask_ccw);
+
+        int bits = movemask(keep);
+        while (bits != 0) {
+            int lane = __builtin_ctz(bits);
+            visible[visible_count++] = i + lane;
+            bits &= bits - 1;
+        }
+    }
+
+    for (; i < count; ++i) {
+        const uint32_t* tri = &indices[i * 3];
+        float area = triangle_signed_area(vertices_vp[tri[0]], vertices_vp[tri[1]], vertices_vp[tri[2]]);
+
+        if ((area > 0.0f && keep_cw) || (area < 0.0f && keep_ccw)) {
+            visible[visible_count++] = i;
+        }
+    }
+
+    return visible_count;
+}
+
+void Rasterizer::draw_triangles(std::span<const uint32_t> indices, const Uniforms& uniforms, FragmentStage fs) {
+
+    auto visible = m_frame_arena.get().allocate<uint32_t>(indices.size() / 3);
+    size_t visible_count = cull_triangles(m_vertices_vp, indices, visible);
+
+    dispatch_raster_features(m_state, fs, [&]<RasterFeatures features>() {
+        for (auto triangle : visible.first(visible_count)) {
+            rasterize_primitive<features>(indices[triangle * 3 + 0],
+                                          indices[triangle * 3 + 1],
+                                          indices[triangle * 3 + 2],
+                                          uniforms, fs, get_viewport_bounds(), m_state);
+        }
+    });
+}
+
+void Rasterizer::process_quantized_vertices(const QuantizedVertices& vertices, size_t first, size_t count,
+                                           const Uniforms& uniforms, VertexShader vs, size_t offset) {
+
+    assert(offset + count <= m_vertices_vp.size());
+
+    auto vertices_vp = m_vertices_vp.subspan(offset, count);
+    vertices.decode_attributes(first, m_attributes.subspan(offset, count));
+
+    if (vs != default_vertex_shader) {
+        vertices.decode_positions(first, vertices_vp);
+        for (auto& v : vertices_vp) {
+            v = viewport_transform(vs(v, uniforms));
+        }
+        return;
+    }
+
+    // the scale and offset of the positions are folded into the matrix, so that
+    // decoding only costs the conversion to floats
+    std::array<f32x4, 4> columns;
+    for (size_t i = 0; i < 3; ++i) {
+        columns[i] = std::bit_cast<f32x4>(uniforms.mvp.m[i]) * vertices.scale[i];
+    }
+    columns[3] = std::bit_cast<f32x4>(uniforms.mvp * vertices.offset);
+
+    for (size_t i = 0; i < count; ++i) {
+        u16x4 quantized;
+        std::memcpy(&quantized, &vertices.positions[first + i], sizeof(quantized));
+        f32x4 p = __builtin_convertvector(quantized, f32x4);
+        f32x4 position = columns[0] * p[0] + columns[1] * p[1] + columns[2] * p[2] + columns[3];
+        vertices_vp[i] = viewport_transform(std::bit_cast<Vec>(position));
+    }
+}
+
+void Rasterizer::process_draw_vertices(std::span<const Vec> vertices, std::span<const Vec> attributes,
+                                       const Uniforms& uniforms, VertexShader vs) {
+
+    allocate_vertices(vertices.size());
+
+    for_each_batch(vertices.size(), vertex_batch_size, [&](size_t begin, size_t end) {
+        process_vertices(vertices.subspan(begin, end - begin),
+                         attributes.empty() ? attributes : attributes.subspan(begin, end - begin),
+                         uniforms, vs, begin);
+    });
+}
+
+void Rasterizer::end_frame() {
+    assert(m_frame_active);
+    m_frame_active = false;
+
+    if (m_retained) {
+        const CommandBuffer* command_buffers[] { &m_frame_commands };
+        render_submission(command_buffers);
+    }
+}
+
+void Rasterizer::submit(std::span<const CommandBuffer* const> command_buffers) {
+
+    if (!m_retained) {
+        render_submission(command_buffers);
+        return;
+    }
+
+    assert(m_frame_active);
+    for (auto* command_buffer : command_buffers) {
+        m_frame_commands.append(*command_buffer);
+    }
+}
+
+void Rasterizer::render_submission(std::span<const CommandBuffer* const> command_buffers) {
+
+    sync_frame_arena();
+    Arena& arena = m_frame_arena.get();
+
+    size_t draw_count = 0;
+    for (auto* command_buffer : command_buffers) {
+        for (auto& command : command_buffer->get_commands()) {
+            draw_count += command.mesh ? command.instances.size() : 1;
+        }
+    }
+
+    m_draws = arena.allocate<SubmittedDraw>(draw_count);
+    uint32_t submitted_count = 0;
+    uint32_t segment = 0;
+
+    for (auto* command_buffer : command_buffers) {
+        for (auto& command : command_buffer->get_commands()) {
+            assert(!command.state.transparent || command.fs.fs);
+
+            bool ordered = command.state.stencil.enabled;
+            segment += ordered;
+
+            if (command.mesh) {
+                submitted_count += setup_instances(command, m_draws.subspan(submitted_count), submitted_count, segment);
+            } else {
+                m_draws[submitted_count] = {
+                    &command, command.vertices, command.indices, &command.uniforms, submitted_count, segment, 0, 0
+                };
+                ++submitted_count;
+            }
+
+            segment += ordered;
+        }
+    }
+
+    m_draws = m_draws.first(submitted_count);
+
+    // grouping draws by state and shader keeps the per-triangle data that is
+    // accessed during rasterization together, transparent draws come after the
+    // opaque ones, so that fragments blended directly are blended over them
+    std::ranges::sort(m_draws, [](const SubmittedDraw& a, const SubmittedDraw& b) {
+        return std::tie(a.segment, a.command->state.transparent, a.command->state,
+                        a.command->fs.fs, a.command->fs.mts, a.order)
+             < std::tie(b.segment, b.command->state.transparent, b.command->state,
+                        b.command->fs.fs, b.command->fs.mts, b.order);
+    });
+
+    size_t vertex_count = 0;
+    size_t triangle_count = 0;
+    size_t max_sequential_count = 0;
+
+    for (auto& draw : m_draws) {
+        draw.vertex_offset = vertex_count;
+        draw.triangle_offset = triangle_count;
+        vertex_count += draw.get_vertex_count();
+        triangle_count += (draw.indices.empty() ? draw.get_vertex_count() : draw.indices.size()) / 3;
+        if (draw.indices.empty()) {
+            max_sequential_count = std::max(max_sequential_count, draw.get_vertex_count());
+        }
+    }
+
+    // the shared index buffer can't grow while jobs are reading it
+    std::ignore = get_sequential_indices(max_sequential_count);
+
+    // vertex processing for all draws, before any rasterization happens
+    allocate_vertices(vertex_count);
+    for_each_batch(vertex_count, vertex_batch_size, [&](size_t begin, size_t end) {
+        process_submitted_vertices(begin, end);
+    });
+
+    // triangle setup, culling and counting the triangles of every tile, every
+    // batch writes its visible triangles to the start of its own range, which
+    // are binned from there, without compacting them first
+    size_t tiles_x = (m_viewport_width + tile_size - 1) / tile_size;
+    size_t tiles_y = (m_viewport_height + tile_size - 1) / tile_size;
+    size_t tile_count = tiles_x * tiles_y;
+    size_t batch_count = (triangle_count + triangle_batch_size - 1) / triangle_batch_size;
+
+    m_triangles = arena.allocate<BinnedTriangle>(triangle_count);
+    auto visible = arena.allocate<uint32_t>(triangle_count);
+    auto visible_counts = arena.allocate<uint32_t>(batch_count);
+    // amount of triangles of every batch in every tile
+    auto tile_counts = arena.allocate<uint32_t>(batch_count * tile_count);
+
+    for_each_batch(triangle_count, triangle_batch_size, [&](size_t begin, size_t end) {
+        size_t batch = begin / triangle_batch_size;
+        visible_counts[batch] = setup_submitted_triangles(begin, end, visible,
+                                                          tile_counts.subspan(batch * tile_count, tile_count));
+    });
+
+    bin_triangles(visible_counts, tile_counts);
+
+    // all tiles are redrawn if there is no previous submission, or the framebuffer has been cleared since
+    bool redraw = true;
+
+    if (m_retained) {
+        m_draw_hashes = arena.allocate<uint64_t>(m_draws.size());
+        for (size_t i = 0; i < m_draws.size(); ++i) {
+            const SubmittedDraw& draw = m_draws[i];
+            m_draw_hashes[i] = draw.command->get_hash();
+            if (draw.command->mesh) {
+                m_draw_hashes[i] = DrawCommand::hash_matrix(m_draw_hashes[i], draw.uniforms->model);
+                m_draw_hashes[i] = hash_combine(m_draw_hashes[i], std::bit_cast<uintptr_t>(draw.vertices.data()));
+            }
+        }
+
+        redraw = m_tile_hashes.size() != tile_count || m_retained_generation != m_framebuffer.get_generation();
+        m_tile_hashes.resize(tile_count);
+        m_retained_generation = m_framebuffer.get_generation();
+    }
+
+    std::atomic<size_t> redrawn_tile_count = 0;
+
+    // tiles differ a lot in cost, so every tile is a job of its own
+    for_each_batch(tile_count, 1, [&](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; ++tile) {
+            if (rasterize_tile(tile, redraw)) {
+                redrawn_tile_count.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    m_redrawn_tile_count = redrawn_tile_count;
+}
+
+size_t Rasterizer::setup_instances(const DrawCommand& command, std::span<SubmittedDraw> draws,
+                                   uint32_t order, uint32_t segment) {
+
+    const Mesh& mesh = *command.mesh;
+    const Mat& view_projection = command.uniforms.view_projection;
+    Frustum frustum(view_projection);
+
+    auto uniforms = m_frame_arena.get().allocate<Uniforms>(command.instances.size());
+    size_t count = 0;
+
+    for (auto& model : command.instances) {
+        // whole instances are culled, before any of their vertices are processed
+        if (!frustum.is_visible(mesh.sphere.transformed(model))) continue;
+
+        Uniforms& instance_uniforms = uniforms[count];
+        instance_uniforms = command.uniforms;
+        instance_uniforms.model = model;
+        instance_uniforms.mvp = view_projection * model;
+
+        float area = mesh.sphere.transformed(instance_uniforms.mvp)
+            .get_projected_area(m_viewport_width, m_viewport_height);
+        const IndexedMesh* lod = mesh.select_lod(area, instance_lod_pixels_per_triangle);
+
+        draws[count] = {
+            &command,
+            lod ? std::span<const Vec>(lod->vertices) : std::span<const Vec>(mesh.vertices),
+            lod ? std::span<const uint32_t>(lod->indices) : std::span<const uint32_t>(),
+            &instance_uniforms,
+            static_cast<uint32_t>(order + count),
+            segment,
+            0,
+            0,
+        };
+        ++count;
+    }
+
+    return count;
+}
+
+void Rasterizer::process_submitted_vertices(size_t begin, size_t end) {
+
+    // last draw starting at or before begin, draws without vertices are skipped
+    auto draw = std::ranges::upper_bound(m_draws, begin, {}, &SubmittedDraw::vertex_offset) - 1;
+
+    for (; begin < end; ++draw) {
+        const DrawCommand& command = *draw->command;
+        size_t first = begin - draw->vertex_offset;
+        size_t last = std::min(end - draw->vertex_offset, draw->get_vertex_count());
+
+        if (command.quantized) {
+            process_quantized_vertices(*command.quantized, first, last - first, *draw->uniforms, command.vs, begin);
+        } else {
+            process_vertices(draw->vertices.subspan(first, last - first),
+                             command.attributes.empty() ? command.attributes : command.attributes.subspan(first, last - first),
+                             *draw->uniforms, command.vs, begin);
+        }
+
+        begin = draw->vertex_offset + last;
+    }
+}
+
+size_t Rasterizer::setup_submitted_triangles(size_t begin, size_t end, std::span<uint32_t> visible,
+                                             std::span<uint32_t> tile_counts) {
+
+    size_t tiles_x = (m_viewport_width + tile_size - 1) / tile_size;
+    auto viewport = get_viewport_bounds();
+    std::ranges::fill(tile_counts, 0);
+
+    size_t visible_count = 0;
+    auto draw = std::ranges::upper_bound(m_draws, begin, {}, &SubmittedDraw::triangle_offset) - 1;
+
+    for (size_t triangle = begin; triangle < end; ++draw) {
+        const DrawCommand& command = *draw->command;
+        auto vertices_vp = m_vertices_vp.subspan(draw->vertex_offset, draw->get_vertex_count());
+
+        std::span<const uint32_t> indices = draw->indices;
+        if (indices.empty()) {
+            indices = get_sequential_indices(draw->get_vertex_count());
+        }
+
+        size_t first = triangle - draw->triangle_offset;
+        size_t last = std::min(end - draw->triangle_offset, indices.size() / 3);
+        auto range = indices.subspan(first * 3, (last - first) * 3);
+        auto range_visible = visible.subspan(triangle, last - first);
+
+        size_t count = cull_triangles(vertices_vp, range, command.state, range_visible);
+
+        for (auto index : range_visible.first(count)) {
+            uint32_t a = draw->vertex_offset + range[index * 3 + 0];
+            uint32_t b = draw->vertex_offset + range[index * 3 + 1];
+            uint32_t c = draw->vertex_offset + range[index * 3 + 2];
+
+            const Vec& a_vp = m_vertices_vp[a];
+            const Vec& b_vp = m_vertices_vp[b];
+            const Vec& c_vp = m_vertices_vp[c];
+            if (!is_inside_guard_band(a_vp) || !is_inside_guard_band(b_vp) || !is_inside_guard_band(c_vp)) continue;
+
+            // edges and vertices may touch pixels whose centers are outside of the triangle
+            auto bounds = command.state.polygon_mode == PolygonMode::Fill
+                ? get_triangle_bounds(snap_to_grid(a_vp), snap_to_grid(b_vp), snap_to_grid(c_vp), viewport)
+                : get_conservative_bounds(snap_to_grid(a_vp), snap_to_grid(b_vp), snap_to_grid(c_vp),
+                                          command.state.antialiasing ? 1 : 0, viewport);
+
+            // small triangles often cover no pixel center, and are dropped before binning
+            if (bounds.min_x > bounds.max_x || bounds.min_y > bounds.max_y) continue;
+
+            BinnedTriangle& binned = m_triangles[begin + visible_count++];
+            binned = {
+                static_cast<uint32_t>(draw - m_draws.begin()),
+                a, b, c,
+                static_cast<uint16_t>(bounds.min_x / tile_size),
+                static_cast<uint16_t>(bounds.min_y / tile_size),
+                static_cast<uint16_t>(bounds.max_x / tile_size),
+                static_cast<uint16_t>(bounds.max_y / tile_size),
+            };
+
+            for (size_t y = binned.tile_min_y; y <= binned.tile_max_y; ++y) {
+                for (size_t x = binned.tile_min_x; x <= binned.tile_max_x; ++x) {
+                    ++tile_counts[y * tiles_x + x];
+                }
+            }
+        }
+
+        triangle = draw->triangle_offset + last;
+    }
+
+    return visible_count;
+}
+
+void Rasterizer::bin_triangles(std::span<const uint32_t> visible_counts, std::span<uint32_t> batch_cursors) {
+
+    size_t tiles_x = (m_viewport_width + tile_size - 1) / tile_size;
+    size_t tiles_y = (m_viewport_height + tile_size - 1) / tile_size;
+    size_t tile_count = tiles_x * tiles_y;
+    size_t batch_count = visible_counts.size();
+
+    Arena& arena = m_frame_arena.get();
+    m_bin_offsets = arena.allocate<uint32_t>(tile_count + 1);
+
+    // the batches of every tile are laid out one after another, so that every
+    // bin stays in submission order, the counts are walked batch by batch, as
+    // walking them tile by tile misses the cache on every batch once there are
+    // thousands of them (e.g. instanced draws)
+    std::ranges::fill(m_bin_offsets, 0);
+    for (size_t batch = 0; batch < batch_count; ++batch) {
+        for (size_t tile = 0; tile < tile_count; ++tile) {
+            m_bin_offsets[tile + 1] += batch_cursors[batch * tile_count + tile];
+        }
+    }
+    for (size_t tile = 0; tile < tile_count; ++tile) {
+        m_bin_offsets[tile + 1] += m_bin_offsets[tile];
+    }
+
+    // the counts are turned into the positions the batches write their triangles
+    // to, which start where the previous batch of the tile ended
+    auto tile_cursors = arena.allocate<uint32_t>(tile_count);
+    std::ranges::copy(m_bin_offsets.first(tile_count), tile_cursors.begin());
+    for (size_t batch = 0; batch < batch_count; ++batch) {
+        for (size_t tile = 0; tile < tile_count; ++tile) {
+            uint32_t& cursor = batch_cursors[batch * tile_count + tile];
+            uint32_t count = cursor;
+            cursor = tile_cursors[tile];
+            tile_cursors[tile] += count;
+        }
+    }
+
+    m_bin_triangles = arena.allocate<uint32_t>(m_bin_offsets[tile_count]);
+
+    for_each_batch(batch_count, 1, [&](size_t begin, size_t end) {
+        for (size_t batch = begin; batch < end; ++batch) {
+            auto cursors = batch_cursors.subspan(batch * tile_count, tile_count);
+            size_t first = batch * triangle_batch_size;
+
+            for (size_t index = first; index < first + visible_counts[batch]; ++index) {
+                const BinnedTriangle& triangle = m_triangles[index];
+                for (size_t y = triangle.tile_min_y; y <= triangle.tile_max_y; ++y) {
+                    for (size_t x = triangle.tile_min_x; x <= triangle.tile_max_x; ++x) {
+                        m_bin_triangles[cursors[y * tiles_x + x]++] = index;
+                    }
+                }
+            }
+        }
+    });
+}
+
+bool Rasterizer::rasterize_tile(size_t tile, bool redraw) {
+
+    int tiles_x = (m_viewport_width + tile_size - 1) / tile_size;
+    int tile_x = tile % tiles_x * tile_size;
+    int tile_y = tile / tiles_x * tile_size;
+
+    auto viewport = get_viewport_bounds();
+    PixelBounds scissor {
+        tile_x,
+        tile_y,
+        std::min<int>(tile_x + tile_size - 1, viewport.max_x),
+        std::min<int>(tile_y + tile_size - 1, viewport.max_y),
+    };
+
+    auto bin = m_bin_triangles.subspan(m_bin_offsets[tile], m_bin_offsets[tile + 1] - m_bin_offsets[tile]);
+
+    if (m_retained) {
+        // the triangles of a draw are next to each other in the bin
+        uint64_t hash = 0;
+        uint32_t previous_draw = std::numeric_limits<uint32_t>::max();
+        for (auto index : bin) {
+            uint32_t draw = m_triangles[index].draw;
+            if (draw == previous_draw) continue;
+            hash = hash_combine(hash, m_draw_hashes[draw]);
+            previous_draw = draw;
+        }
+
+        if (!redraw && hash == m_tile_hashes[tile]) return false;
+
+        m_tile_hashes[tile] = hash;
+        m_framebuffer.clear(scissor.min_x, scissor.min_y, scissor.max_x, scissor.max_y);
+    }
+
+    size_t thread_index = get_thread_index();
+    TileFragments& fragments = m_tile_fragments[thread_index];
+    fragments = { scissor, {}, {} };
+
+    // the raster features are dispatched once for the consecutive triangles of every draw
+    for (size_t begin = 0; begin < bin.size();) {
+        uint32_t draw_index = m_triangles[bin[begin]].draw;
+        size_t end = begin + 1;
+        while (end < bin.size() && m_triangles[bin[end]].draw == draw_index) ++end;
+
+        const SubmittedDraw& draw = m_draws[draw_index];
+        const DrawCommand& command = *draw.command;
+
+        if (command.state.transparent && fragments.lists.empty()) {
+            Arena& arena = m_frame_arena.get(thread_index);
+            fragments.lists = arena.allocate<TransparentFragment*>(tile_size * tile_size);
+            fragments.counts = arena.allocate<uint8_t>(tile_size * tile_size);
+            std::ranges::fill(fragments.lists, nullptr);
+            std::ranges::fill(fragments.counts, 0);
+        }
+
+        dispatch_raster_features(command.state, command.fs, [&]<RasterFeatures features>() {
+            for (auto index : bin.subspan(begin, end - begin)) {
+                const BinnedTriangle& triangle = m_triangles[index];
+                rasterize_primitive<features>(triangle.a, triangle.b, triangle.c, *draw.uniforms,
+                                              command.fs, scissor, command.state);
+            }
+        });
+
+        begin = end;
+    }
+
+    if (!fragments.lists.empty()) {
+        resolve_transparent_fragments(fragments);
+    }
+
+    return true;
+}
+
+template <typename F>
+void Rasterizer::for_each_covered_pixel(FixedPoint a, FixedPoint b, FixedPoint c, PixelBounds bounds, F&& shade) {
+
+    int64_t bias_a = get_fill_bias(b, c);
+    int64_t bias_b = get_fill_bias(c, a);
+    int64_t bias_c = get_fill_bias(a, b);
+
+    // change of the edge functions when stepping one pixel along x or y
+    int64_t step_x_a = -static_cast<int64_t>(c.y - b.y) * subpixel_scale;
+    int64_t step_x_b = -static_cast<int64_t>(a.y - c.y) * subpixel_scale;
+    int64_t step_x_c = -static_cast<int64_t>(b.y - a.y) * subpixel_scale;
+    int64_t step_y_a = static_cast<int64_t>(c.x - b.x) * subpixel_scale;
+    int64_t step_y_b = static_cast<int64_t>(a.x - c.x) * subpixel_scale;
+    int64_t step_y_c = static_cast<int64_t>(b.x - a.x) * subpixel_scale;
+
+    constexpr int32_t half = subpixel_scale / 2;
+
+    // small triangles covering at most 2x2 pixels are tested directly, dense
+    // meshes mostly consist of these
+    if (bounds.max_x - bounds.min_x <= 1 && bounds.max_y - bounds.min_y <= 1) {
+        for (int y = bounds.min_y; y <= bounds.max_y; ++y) {
+            for (int x = bounds.min_x; x <= bounds.max_x; ++x) {
+                FixedPoint p { x * subpixel_scale + half, y * subpixel_scale + half };
+                int64_t e_a = edge_function(b, c, p);
+                int64_t e_b = edge_function(c, a, p);
+                int64_t e_c = edge_function(a, b, p);
+
+                if (e_a + bias_a >= 0 && e_b + bias_b >= 0 && e_c + bias_c >= 0) {
+                    shade(x, y, e_a, e_b, e_c);
+                }
+            }
+        }
+        return;
+    }
+
+    // edge functions at the first pixel center, which are then stepped incrementally
+    FixedPoint origin { bounds.min_x * subpixel_scale + half, bounds.min_y * subpixel_scale + half };
+    int64_t row_a = edge_function(b, c, origin);
+    int64_t row_b = edge_function(c, a, origin);
+    int64_t row_c = edge_function(a, b, origin);
+
+    for (int y = bounds.min_y; y <= bounds.max_y; ++y) {
+        int64_t e_a = row_a;
+        int64_t e_b = row_b;
+        int64_t e_c = row_c;
+
+        for (int x = bounds.min_x; x <= bounds.max_x; ++x) {
+            if (e_a + bias_a >= 0 && e_b + bias_b >= 0 && e_c + bias_c >= 0) {
+                shade(x, y, e_a, e_b, e_c);
+            }
+
+            e_a += step_x_a;
+            e_b += step_x_b;
+            e_c += step_x_c;
+        }
+
+        row_a += step_y_a;
+        row_b += step_y_b;
+        row_c += step_y_c;
+    }
+}
+
+template <Rasterizer::RasterFeatures features>
+void Rasterizer::rasterize_triangle(uint32_t index_a, uint32_t index_b, uint32_t index_c,
+                                    const Uniforms& uniforms, FragmentStage fs, PixelBounds scissor,
+                                    const PipelineState& state) {
+
+    Vec a_vp = m_vertices_vp[index_a];
+    Vec b_vp = m_vertices_vp[index_b];
+    Vec c_vp = m_vertices_vp[index_c];
+
+    for (auto& v : { a_vp, b_vp, c_vp }) {
+        if (!is_inside_guard_band(v)) return;
+    }
+
+    FixedPoint a = snap_to_grid(a_vp);
+    FixedPoint b = snap_to_grid(b_vp);
+    FixedPoint c = snap_to_grid(c_vp);
+
+    int64_t area = edge_function(a, b, c);
+
+    // triangles may become degenerate after snapping
+    if (area == 0) return;
+
+    // face culling has already been applied during triangle setup, so only the
+    // orientation relative to the triangle matters
+    if (area < 0) {
+        std::swap(b, c);
+        std::swap(b_vp, c_vp);
+        std::swap(index_b, index_c);
+        area = -area;
+    }
+
+    auto bounds = get_triangle_bounds(a, b, c, scissor);
+
+    // no pixel center is covered
+    if (bounds.min_x > bounds.max_x || bounds.min_y > bounds.max_y) return;
+
+    float inv_area = 1.0f / area;
 
-    auto aabb = get_triangle_aabb(a_vp, b_vp, c_vp);
+    // change of the edge functions when stepping one pixel along x or y
+    int64_t step_x_a = -static_cast<int64_t>(c.y - b.y) * subpixel_scale;
+    int64_t step_x_b = -static_cast<int64_t>(a.y - c.y) * subpixel_scale;
+    int64_t step_x_c = -static_cast<int64_t>(b.y - a.y) * subpixel_scale;
+    int64_t step_y_a = static_cast<int64_t>(c.x - b.x) * subpixel_scale;
+    int64_t step_y_b = static_cast<int64_t>(a.x - c.x) * subpixel_scale;
+    int64_t step_y_c = static_cast<int64_t>(b.x - a.x) * subpixel_scale;
+
+    TriangleSetup setup;
+    setup.a = a_vp;
+    setup.b = b_vp;
+    setup.c = c_vp;
+    setup.attribute_a = m_attributes[index_a];
+    setup.attribute_b = m_attributes[index_b];
+    setup.attribute_c = m_attributes[index_c];
+
+    // attributes are interpolated linearly in screen space, so their derivatives
+    // are constant across the triangle, and equal to the differences across a 2x2 quad
+    setup.attribute_dx = setup.attribute_a * (step_x_a * inv_area)
+                       + setup.attribute_b * (step_x_b * inv_area)
+                       + setup.attribute_c * (step_x_c * inv_area);
+    setup.attribute_dy = setup.attribute_a * (step_y_a * inv_area)
+                       + setup.attribute_b * (step_y_b * inv_area)
+                       + setup.attribute_c * (step_y_c * inv_area);
+
+    auto shade = [&](int x, int y, int64_t e_a, int64_t e_b, int64_t e_c) {
+        rasterize_pixel<features>(x, y, e_a * inv_area, e_b * inv_area, e_c * inv_area, setup, uniforms, fs, state);
+    };
 
     // TODO: double buffering
     // TODO: thread pool
@@ -24,16 +803,259 @@ void Rasterizer::draw_triangle(Vec a_ndc, Vec b_ndc, Vec c_ndc, VertexShader vs,
     // TODO: reconstruct triangles that have a vertex off-screen
     // TODO: vertex shader outputs
 
-    for (float x = aabb.x; x < aabb.width; ++x) {
-        for (float y = aabb.y; y < aabb.height; ++y) {
-            Vec p { x, y, 0.0f, 1.0f };
-            rasterize_pixel(p, a_vp, b_vp, c_vp, fs);
+    for_each_covered_pixel(a, b, c, bounds, shade);
+}
+
+template <typename T>
+void Rasterizer::rasterize_depth_triangle(Vec a_vp, Vec b_vp, Vec c_vp, Buffer<T>& target, PixelBounds scissor) {
+
+    for (auto& v : { a_vp, b_vp, c_vp }) {
+        if (!is_inside_guard_band(v)) return;
+    }
+
+    FixedPoint a = snap_to_grid(a_vp);
+    FixedPoint b = snap_to_grid(b_vp);
+    FixedPoint c = snap_to_grid(c_vp);
+
+    int64_t area = edge_function(a, b, c);
+    if (area == 0) return;
+
+    if (area < 0) {
+        std::swap(b, c);
+        std::swap(b_vp, c_vp);
+        area = -area;
+    }
+
+    auto bounds = get_triangle_bounds(a, b, c, scissor);
+    if (bounds.min_x > bounds.max_x || bounds.min_y > bounds.max_y) return;
+
+    float inv_area = 1.0f / area;
+
+    // the depth is interpolated exactly like in rasterize_pixel(), so that
+    // a depth pre-pass matches the depths of the following color pass
+    for_each_covered_pixel(a, b, c, bounds, [&](int x, int y, int64_t e_a, int64_t e_b, int64_t e_c) {
+        float depth = a_vp.z * (e_a * inv_area) + b_vp.z * (e_b * inv_area) + c_vp.z * (e_c * inv_area);
+
+        if constexpr (std::is_same_v<T, DepthStencil>) {
+            DepthStencil stored = target.get(x, y);
+            if (depth < stored.depth) return;
+            stored.depth = depth;
+            target.write(x, y, stored);
+        } else {
+            if (depth < target.get(x, y)) return;
+            target.write(x, y, depth);
         }
+    });
+}
+
+template <typename T>
+void Rasterizer::render_depth_to(std::span<const Vec> vertices, std::span<const uint32_t> indices,
+                                 const Uniforms& uniforms, VertexShader vs, Buffer<T>& target,
+                                 int width, int height) {
+
+    assert(indices.size() % 3 == 0);
+
+    sync_frame_arena();
+    Arena& arena = m_frame_arena.get();
+
+    // attributes are not needed, so only positions are processed
+    auto vertices_vp = arena.allocate<Vec>(vertices.size());
+    for_each_batch(vertices.size(), vertex_batch_size, [&](size_t begin, size_t end) {
+        shade_vertices(vertices.subspan(begin, end - begin), uniforms, vs,
+                       vertices_vp.subspan(begin, end - begin), width, height);
+    });
+
+    auto visible = arena.allocate<uint32_t>(indices.size() / 3);
+    visible = visible.first(cull_triangles(vertices_vp, indices, m_state, visible));
+
+    // the triangles are binned into horizontal bands of tile_size rows, like
+    // bin_triangles() does for tiles, and every band is rasterized on its own
+    size_t band_count = (height + tile_size - 1) / tile_size;
+    size_t batch_count = (visible.size() + triangle_batch_size - 1) / triangle_batch_size;
+    PixelBounds viewport { 0, 0, width - 1, height - 1 };
+
+    // the first and last band of every visible triangle, the first is past the
+    // last for triangles outside of the viewport
+    auto band_ranges = arena.allocate<std::array<uint32_t, 2>>(visible.size());
+    auto batch_cursors = arena.allocate<uint32_t>(batch_count * band_count);
+
+    for_each_batch(visible.size(), triangle_batch_size, [&](size_t begin, size_t end) {
+        auto counts = batch_cursors.subspan(begin / triangle_batch_size * band_count, band_count);
+        std::ranges::fill(counts, 0);
+
+        for (size_t i = begin; i < end; ++i) {
+            const Vec& a = vertices_vp[indices[visible[i] * 3 + 0]];
+            const Vec& b = vertices_vp[indices[visible[i] * 3 + 1]];
+            const Vec& c = vertices_vp[indices[visible[i] * 3 + 2]];
+
+            band_ranges[i] = { 1, 0 };
+            if (!is_inside_guard_band(a) || !is_inside_guard_band(b) || !is_inside_guard_band(c)) continue;
+
+            auto bounds = get_triangle_bounds(snap_to_grid(a), snap_to_grid(b), snap_to_grid(c), viewport);
+            if (bounds.min_x > bounds.max_x || bounds.min_y > bounds.max_y) continue;
+
+            band_ranges[i] = { static_cast<uint32_t>(bounds.min_y / tile_size),
+                               static_cast<uint32_t>(bounds.max_y / tile_size) };
+            for (size_t band = band_ranges[i][0]; band <= band_ranges[i][1]; ++band) {
+                ++counts[band];
+            }
+        }
+    });
+
+    auto band_offsets = arena.allocate<uint32_t>(band_count + 1);
+    uint32_t offset = 0;
+    for (size_t band = 0; band < band_count; ++band) {
+        band_offsets[band] = offset;
+        for (size_t batch = 0; batch < batch_count; ++batch) {
+            uint32_t& cursor = batch_cursors[batch * band_count + band];
+            uint32_t count = cursor;
+            cursor = offset;
+            offset += count;
+        }
+    }
+    band_offsets[band_count] = offset;
+
+    auto band_triangles = arena.allocate<uint32_t>(offset);
+
+    for_each_batch(visible.size(), triangle_batch_size, [&](size_t begin, size_t end) {
+        auto cursors = batch_cursors.subspan(begin / triangle_batch_size * band_count, band_count);
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t band = band_ranges[i][0]; band <= band_ranges[i][1]; ++band) {
+                band_triangles[cursors[band]++] = visible[i];
+            }
+        }
+    });
+
+    for_each_batch(band_count, 1, [&](size_t begin, size_t end) {
+        for (size_t band = begin; band < end; ++band) {
+            int min_y = band * tile_size;
+            PixelBounds scissor { 0, min_y, width - 1, std::min<int>(min_y + tile_size, height) - 1 };
+
+            for (size_t i = band_offsets[band]; i < band_offsets[band + 1]; ++i) {
+                uint32_t triangle = band_triangles[i];
+                rasterize_depth_triangle(vertices_vp[indices[triangle * 3 + 0]],
+                                         vertices_vp[indices[triangle * 3 + 1]],
+                                         vertices_vp[indices[triangle * 3 + 2]],
+                                         target, scissor);
+            }
+        }
+    });
+}
+
+void Rasterizer::render_depth(std::span<const Vec> vertices, std::span<const uint32_t> indices,
+                              const Uniforms& uniforms, VertexShader vs, DepthBuffer& depth_buffer) {
+    render_depth_to(vertices, indices, uniforms, vs, depth_buffer, depth_buffer.get_width(), depth_buffer.get_height());
+}
+
+void Rasterizer::render_depth(std::span<const Vec> vertices, std::span<const uint32_t> indices,
+                              const Uniforms& uniforms, VertexShader vs) {
+    assert(!m_retained);
+    render_depth_to(vertices, indices, uniforms, vs, m_framebuffer.get_depth_stencil_buffer(),
+                    m_viewport_width, m_viewport_height);
+}
+
+size_t Rasterizer::count_visible_samples(const Aabb& box, const Uniforms& uniforms, bool early_out) {
+
+    assert(!box.is_empty());
+
+    // bit 0, 1 and 2 of the index select the maximum along x, y and z
+    std::array<Vec, 8> corners;
+    for (size_t i = 0; i < corners.size(); ++i) {
+        corners[i] = {
+            i & 1 ? box.max.x : box.min.x,
+            i & 2 ? box.max.y : box.min.y,
+            i & 4 ? box.max.z : box.min.z,
+            1.0f,
+        };
     }
 
+    // transformed exactly like the vertices of a draw, so a mesh coinciding with
+    // its box gets the same depths
+    std::array<Vec, 8> corners_vp;
+    shade_vertices(corners, uniforms, default_vertex_shader, corners_vp, m_viewport_width, m_viewport_height);
+
+    size_t viewport_pixels = static_cast<size_t>(m_viewport_width) * m_viewport_height;
+    for (auto& corner : corners_vp) {
+        if (!is_inside_guard_band(corner)) return viewport_pixels;
+    }
+
+    // two triangles per face, wound consistently, counter-clockwise from the outside
+    static constexpr std::array<std::array<uint8_t, 3>, 12> faces {{
+        {0, 6, 2}, {0, 4, 6}, {1, 3, 7}, {1, 7, 5},
+        {0, 1, 5}, {0, 5, 4}, {2, 7, 3}, {2, 6, 7},
+        {0, 3, 1}, {0, 2, 3}, {4, 5, 7}, {4, 7, 6},
+    }};
+
+    const DepthStencilBuffer& depth_buffer = m_framebuffer.get_depth_stencil_buffer();
+
+    // counts of the faces with a positive and a negative area
+    std::atomic<size_t> positive_samples = 0;
+    std::atomic<size_t> negative_samples = 0;
+    std::atomic<bool> found = false;
+
+    // every worker tests all faces against its own horizontal band of the viewport
+    int band_count = m_job_system ? m_job_system->get_thread_count() : 1;
+    int band_height = (m_viewport_height + band_count - 1) / band_count;
+
+    for_each_batch(band_count, 1, [&](size_t begin, size_t end) {
+        for (size_t band = begin; band < end; ++band) {
+            int min_y = band * band_height;
+            PixelBounds scissor { 0, min_y, m_viewport_width - 1, std::min(min_y + band_height, m_viewport_height) - 1 };
+            if (scissor.min_y > scissor.max_y) continue;
+
+            size_t counts[2] {};
+
+            for (auto [index_a, index_b, index_c] : faces) {
+                if (early_out && found.load(std::memory_order_relaxed)) return;
+
+                Vec a_vp = corners_vp[index_a];
+                Vec b_vp = corners_vp[index_b];
+                Vec c_vp = corners_vp[index_c];
+                FixedPoint a = snap_to_grid(a_vp);
+                FixedPoint b = snap_to_grid(b_vp);
+                FixedPoint c = snap_to_grid(c_vp);
+
+                int64_t area = edge_function(a, b, c);
+                if (area == 0) continue;
+
+                bool negative = area < 0;
+                if (negative) {
+                    std::swap(b, c);
+                    std::swap(b_vp, c_vp);
+                    area = -area;
+                }
+
+                auto bounds = get_triangle_bounds(a, b, c, scissor);
+                if (bounds.min_x > bounds.max_x || bounds.min_y > bounds.max_y) continue;
+
+                float inv_area = 1.0f / area;
+                size_t& count = counts[negative];
+
+                // the depth is interpolated like in rasterize_pixel()
+                for_each_covered_pixel(a, b, c, bounds, [&](int x, int y, int64_t e_a, int64_t e_b, int64_t e_c) {
+                    float depth = a_vp.z * (e_a * inv_area) + b_vp.z * (e_b * inv_area) + c_vp.z * (e_c * inv_area);
+                    count += depth >= depth_buffer.get(x, y).depth;
+                });
+
+                if (early_out && count > 0) {
+                    found.store(true, std::memory_order_relaxed);
+                    return;
+                }
+            }
+
+            positive_samples += counts[0];
+            negative_samples += counts[1];
+        }
+    });
+
+    if (early_out && found) return 1;
+    return std::max(positive_samples.load(), negative_samples.load());
 }
 
-void Rasterizer::rasterize_pixel(Vec p, Vec a_vp, Vec b_vp, Vec c_vp, FragmentShader fs) {
+template <Rasterizer::RasterFeatures features>
+void Rasterizer::rasterize_pixel(int x, int y, float weight_a, float weight_b, float weight_c,
+                                 const TriangleSetup& triangle, const Uniforms& uniforms, FragmentStage fs,
+                                 const PipelineState& state) {
 
     // TODO: fix msaa
     // int samples = 4;
@@ -62,66 +1084,23 @@ void Rasterizer::rasterize_pixel(Vec p, Vec a_vp, Vec b_vp, Vec c_vp, FragmentSh
     //         break;
     // }
 
-    float abc = triangle_signed_area(a_vp, b_vp, c_vp);
-    float abp = triangle_signed_area(a_vp, b_vp, p);
-    float bcp = triangle_signed_area(b_vp, c_vp, p);
-    float cap = triangle_signed_area(c_vp, a_vp, p);
-
-    float weight_a = bcp / abc;
-    float weight_b = cap / abc;
-    float weight_c = abp / abc;
-
     auto interpolate_value = [&]<typename T>(T a, T b, T c) {
         return a * weight_a + b * weight_b + c * weight_c;
     };
 
-    float depth = interpolate_value(a_vp.z, b_vp.z, c_vp.z);
-
-    float stored_depth = m_framebuffer.get_depth_buffer().get(p.x, p.y);
-    if (depth < stored_depth) return;
-
-    Color color_debug = interpolate_value(Color::red(), Color::green(), Color::blue());
-
-    bool show_aabb = false;
-
-    // test if the current pixel is inside of the triangle
-    bool ccw = abp <= 0 &&
-        bcp <= 0 &&
-        cap <= 0;
-
-    bool cw = abp >= 0 &&
-        bcp >= 0 &&
-        cap >= 0;
-
-    // TODO: wireframe mode
+    float depth = interpolate_value(triangle.a.z, triangle.b.z, triangle.c.z);
 
-    // bool ccw = (weight_a <= 0.01 && weight_a >= 0) ||
-    //            (weight_b <= 0.01 && weight_b >= 0) ||
-    //            (weight_c <= 0.01 && weight_c >= 0);
+    if (!early_test<features>(x, y, depth, state)) return;
 
-    // bool ccw = (abp <= 0 && abp >= -500) ||
-    //            (bcp <= 0 && bcp >= -500) ||
-    //            (cap <= 0 && cap >= -500);
-
-    auto [front, back] = get_faces_from_winding_order(cw, ccw);
-
-    bool should_render = apply_culling(front, back);
-
-    if (should_render) {
-        Color color = fs(p);
-        Color stored_color = m_framebuffer.get_color_buffer().get(p.x, p.y);
-        Color result = blend_colors(color, stored_color);
-        m_framebuffer.get_color_buffer().write(p.x, p.y, color_debug);
-        m_framebuffer.get_depth_buffer().write(p.x, p.y, depth);
-        // colors.push_back(result);
-
-    } else if (show_aabb) {
-        m_framebuffer.get_color_buffer().write(p.x, p.y, Color::red());
+    Fragment fragment {
+        { static_cast<float>(x), static_cast<float>(y), depth, 1.0f },
+        interpolate_value(triangle.attribute_a, triangle.attribute_b, triangle.attribute_c),
+        triangle.attribute_dx,
+        triangle.attribute_dy,
+    };
 
-    }
-    // else {
-    //     colors.push_back(Color(0x0, 0x0, 0x0, 0x0));
-    // }
+    shade_fragment<features>(fragment, uniforms, fs);
+    // colors.push_back(result);
 
     // // cant use color struct for summing up color values, due to integer overflow
     // int r = 0;
@@ -140,3 +1119,435 @@ void Rasterizer::rasterize_pixel(Vec p, Vec a_vp, Vec b_vp, Vec c_vp, FragmentSh
     // m_color_buffer.write(p.x, p.y, color);
 
 }
+
+template <Rasterizer::RasterFeatures features>
+bool Rasterizer::early_test(int x, int y, float depth, const PipelineState& state) {
+
+    if constexpr (!features.depth_test && !features.stencil) {
+        return true;
+
+    } else {
+        DepthStencilBuffer& depth_stencil_buffer = m_framebuffer.get_depth_stencil_buffer();
+        DepthStencil stored = depth_stencil_buffer.get(x, y);
+        bool depth_passed = !features.depth_test || depth >= stored.depth;
+
+        if constexpr (!features.stencil) return depth_passed;
+
+        const StencilState& stencil = state.stencil;
+        bool stencil_passed = compare(stencil.compare, stencil.reference & stencil.read_mask,
+                                      stored.stencil & stencil.read_mask);
+
+        StencilOp op = !stencil_passed ? stencil.fail_op
+                     : !depth_passed ? stencil.depth_fail_op
+                     : stencil.pass_op;
+
+        if (op != StencilOp::Keep) {
+            uint8_t value = apply_stencil_op(op, stored.stencil, stencil.reference);
+            stored.stencil = (stored.stencil & ~stencil.write_mask) | (value & stencil.write_mask);
+            depth_stencil_buffer.write(x, y, stored);
+        }
+
+        return stencil_passed && depth_passed;
+    }
+}
+
+template <Rasterizer::RasterFeatures features>
+void Rasterizer::shade_fragment(const Fragment& fragment, const Uniforms& uniforms, FragmentStage fs, float coverage) {
+
+    int x = fragment.position.x;
+    int y = fragment.position.y;
+
+    if constexpr (features.transparent) {
+        if constexpr (features.color_write) {
+            Color color = fs.fs(fragment, uniforms);
+            if (coverage < 1.0f) {
+                color.a = static_cast<uint8_t>(color.a * coverage);
+            }
+            store_transparent_fragment(x, y, color, fragment.position.z);
+        }
+        return;
+    }
+
+    if constexpr (features.multi_target) {
+        if (coverage < 0.5f) return;
+
+        if constexpr (features.color_write) {
+            FragmentOutputs outputs(m_framebuffer, x, y);
+            fs.mts(fragment, uniforms, outputs);
+        }
+
+    } else if constexpr (features.color_write) {
+        Color color = fs.fs(fragment, uniforms);
+        if (coverage < 1.0f) {
+            color.a = static_cast<uint8_t>(color.a * coverage);
+        }
+
+        if constexpr (features.blending) {
+            Color stored_color = m_framebuffer.get_color_buffer().get(x, y);
+            color = blend_colors(color, stored_color);
+        }
+        m_framebuffer.get_color_buffer().write(x, y, color);
+    }
+
+    if constexpr (features.depth_write) {
+        if (features.multi_target || coverage >= 1.0f) {
+            DepthStencilBuffer& depth_stencil_buffer = m_framebuffer.get_depth_stencil_buffer();
+            DepthStencil stored = depth_stencil_buffer.get(x, y);
+            stored.depth = fragment.position.z;
+            depth_stencil_buffer.write(x, y, stored);
+        }
+    }
+}
+
+void Rasterizer::store_transparent_fragment(int x, int y, Color color, float depth) {
+
+    size_t thread_index = get_thread_index();
+    TileFragments& tile = m_tile_fragments[thread_index];
+    size_t pixel = (y - tile.bounds.min_y) * tile_size + (x - tile.bounds.min_x);
+    TransparentFragment*& list = tile.lists[pixel];
+
+    if (tile.counts[pixel] < max_transparent_fragments) {
+        TransparentFragment& fragment = m_frame_arena.get(thread_index).allocate<TransparentFragment>(1)[0];
+        fragment = { color, depth, list };
+        list = &fragment;
+        ++tile.counts[pixel];
+        return;
+    }
+
+    // the list is full, it keeps the closest fragments, and the furthest one is
+    // blended into the color buffer right away
+    TransparentFragment* furthest = list;
+    for (TransparentFragment* fragment = list->next; fragment; fragment = fragment->next) {
+        if (fragment->depth < furthest->depth) furthest = fragment;
+    }
+
+    if (depth > furthest->depth) {
+        std::swap(color, furthest->color);
+        furthest->depth = depth;
+    }
+
+    ColorBuffer& color_buffer = m_framebuffer.get_color_buffer();
+    color_buffer.write(x, y, blend_colors(color, color_buffer.get(x, y)));
+}
+
+void Rasterizer::resolve_transparent_fragments(const TileFragments& tile) {
+
+    ColorBuffer& color_buffer = m_framebuffer.get_color_buffer();
+    std::array<TransparentFragment, max_transparent_fragments> sorted;
+
+    for (int y = tile.bounds.min_y; y <= tile.bounds.max_y; ++y) {
+        for (int x = tile.bounds.min_x; x <= tile.bounds.max_x; ++x) {
+            size_t pixel = (y - tile.bounds.min_y) * tile_size + (x - tile.bounds.min_x);
+
+            // opaque surfaces drawn after a fragment may still hide it
+            float opaque_depth = m_framebuffer.get_depth(x, y);
+
+            // the lists are newest first, fragments with equal depths are
+            // blended in the order they arrived in
+            size_t count = 0;
+            for (TransparentFragment* fragment = tile.lists[pixel]; fragment; fragment = fragment->next) {
+                if (fragment->depth < opaque_depth) continue;
+
+                size_t i = count++;
+                for (; i > 0 && sorted[i - 1].depth < fragment->depth; --i) {
+                    sorted[i] = sorted[i - 1];
+                }
+                sorted[i] = *fragment;
+            }
+
+            if (count == 0) continue;
+
+            // back to front, furthest first
+            Color color = color_buffer.get(x, y);
+            for (size_t i = count; i-- > 0;) {
+                color = blend_colors(sorted[i].color, color);
+            }
+            color_buffer.write(x, y, color);
+        }
+    }
+}
+
+template <Rasterizer::RasterFeatures features>
+void Rasterizer::rasterize_primitive(uint32_t a, uint32_t b, uint32_t c, const Uniforms& uniforms,
+                                     FragmentStage fs, PixelBounds scissor, const PipelineState& state) {
+
+    switch (state.polygon_mode) {
+        using enum PolygonMode;
+
+        case Fill:
+            rasterize_triangle<features>(a, b, c, uniforms, fs, scissor, state);
+            break;
+
+        case Line:
+            rasterize_line<features>(a, b, uniforms, fs, scissor, state);
+            rasterize_line<features>(b, c, uniforms, fs, scissor, state);
+            rasterize_line<features>(c, a, uniforms, fs, scissor, state);
+            break;
+
+        case Point:
+            rasterize_point<features>(a, uniforms, fs, scissor, state);
+            rasterize_point<features>(b, uniforms, fs, scissor, state);
+            rasterize_point<features>(c, uniforms, fs, scissor, state);
+            break;
+
+        default: assert(!"invalid polygon mode");
+    }
+}
+
+template <Rasterizer::RasterFeatures features>
+void Rasterizer::rasterize_line(uint32_t index_a, uint32_t index_b, const Uniforms& uniforms, FragmentStage fs,
+                                PixelBounds scissor, const PipelineState& state) {
+
+    Vec a = m_vertices_vp[index_a];
+    Vec b = m_vertices_vp[index_b];
+    Vec attribute_a = m_attributes[index_a];
+    Vec attribute_b = m_attributes[index_b];
+
+    // lines further away from the viewport are dropped like triangles
+    if (!is_inside_guard_band(a) || !is_inside_guard_band(b)) return;
+
+    auto lerp = [](auto x, auto y, float t) {
+        return x + (y - x) * t;
+    };
+
+    auto plot = [&](int x, int y, float t, Vec attribute_dx, Vec attribute_dy, float coverage) {
+        if (coverage <= 0.0f || !is_inside(x, y, scissor)) return;
+
+        float depth = lerp(a.z, b.z, t);
+        if (!early_test<features>(x, y, depth, state)) return;
+
+        Fragment fragment {
+            { static_cast<float>(x), static_cast<float>(y), depth, 1.0f },
+            lerp(attribute_a, attribute_b, t),
+            attribute_dx,
+            attribute_dy,
+        };
+        shade_fragment<features>(fragment, uniforms, fs, coverage);
+    };
+
+    // every pixel of the line only depends on its endpoints, so that a line split
+    // across tiles is identical to the unsplit one, clipping only narrows the
+    // range of steps along the major axis
+    bool x_major = std::abs(b.x - a.x) >= std::abs(b.y - a.y);
+    int scissor_min = x_major ? scissor.min_x : scissor.min_y;
+    int scissor_max = x_major ? scissor.max_x : scissor.max_y;
+
+    if (!state.antialiasing) {
+        // integer dda between the pixels containing the endpoints, after k steps
+        // the offset on the minor axis is round(k * minor_delta / steps)
+        int major0 = std::floor(x_major ? a.x : a.y);
+        int minor0 = std::floor(x_major ? a.y : a.x);
+        int major1 = std::floor(x_major ? b.x : b.y);
+        int minor1 = std::floor(x_major ? b.y : b.x);
+
+        int steps = std::abs(major1 - major0);
+        int64_t minor_delta = std::abs(minor1 - minor0);
+        int major_step = major0 <= major1 ? 1 : -1;
+        int minor_step = minor0 <= minor1 ? 1 : -1;
+
+        int first = std::max(0, major_step > 0 ? scissor_min - major0 : major0 - scissor_max);
+        int last = std::min(steps, major_step > 0 ? scissor_max - major0 : major0 - scissor_min);
+        if (first > last) return;
+
+        Vec attribute_step = steps ? (attribute_b - attribute_a) / steps : Vec {};
+        Vec attribute_dx = x_major ? attribute_step * major_step : Vec {};
+        Vec attribute_dy = x_major ? Vec {} : attribute_step * major_step;
+
+        // the rounded offset, kept as quotient and remainder of the division
+        int64_t denominator = 2 * std::max(steps, 1);
+        int64_t numerator = 2 * first * minor_delta + steps;
+        int64_t offset = numerator / denominator;
+        int64_t remainder = numerator % denominator;
+
+        for (int k = first; k <= last; ++k) {
+            int major = major0 + k * major_step;
+            int minor = minor0 + offset * minor_step;
+            float t = steps ? static_cast<float>(k) / steps : 0.0f;
+
+            if (x_major) {
+                plot(major, minor, t, attribute_dx, attribute_dy, 1.0f);
+            } else {
+                plot(minor, major, t, attribute_dx, attribute_dy, 1.0f);
+            }
+
+            remainder += 2 * minor_delta;
+            if (remainder >= denominator) {
+                remainder -= denominator;
+                ++offset;
+            }
+        }
+        return;
+    }
+
+    // xiaolin wu's algorithm, every step along the major axis covers the two
+    // closest pixels on the minor axis, weighted by their distance to the line
+    // pixel centers are moved to integer coordinates
+    float major0 = (x_major ? a.x : a.y) - 0.5f;
+    float minor0 = (x_major ? a.y : a.x) - 0.5f;
+    float major1 = (x_major ? b.x : b.y) - 0.5f;
+    float minor1 = (x_major ? b.y : b.x) - 0.5f;
+
+    float length = major1 - major0;
+    float gradient = length != 0.0f ? (minor1 - minor0) / length : 0.0f;
+    Vec attribute_step = length != 0.0f ? (attribute_b - attribute_a) / length : Vec {};
+    Vec attribute_dx = x_major ? attribute_step : Vec {};
+    Vec attribute_dy = x_major ? Vec {} : attribute_step;
+
+    int first = std::max<int>(std::floor(std::min(major0, major1) + 0.5f), scissor_min);
+    int last = std::min<int>(std::floor(std::max(major0, major1) + 0.5f), scissor_max);
+
+    for (int major = first; major <= last; ++major) {
+        float t = length != 0.0f ? std::clamp((major - major0) / length, 0.0f, 1.0f) : 0.0f;
+        float minor = minor0 + gradient * (major - major0);
+        int minor_pixel = std::floor(minor);
+        float fraction = minor - minor_pixel;
+
+        if (x_major) {
+            plot(major, minor_pixel, t, attribute_dx, attribute_dy, 1.0f - fraction);
+            plot(major, minor_pixel + 1, t, attribute_dx, attribute_dy, fraction);
+        } else {
+            plot(minor_pixel, major, t, attribute_dx, attribute_dy, 1.0f - fraction);
+            plot(minor_pixel + 1, major, t, attribute_dx, attribute_dy, fraction);
+        }
+    }
+}
+
+template <Rasterizer::RasterFeatures features>
+void Rasterizer::rasterize_point(uint32_t index, const Uniforms& uniforms, FragmentStage fs,
+                                 PixelBounds scissor, const PipelineState& state) {
+
+    Vec point = m_vertices_vp[index];
+    Vec attribute = m_attributes[index];
+
+    // also rejects points too far away to be converted to integers
+    bool visible = point.x >= scissor.min_x - 1 && point.x < scissor.max_x + 2
+                && point.y >= scissor.min_y - 1 && point.y < scissor.max_y + 2;
+    if (!visible) return;
+
+    auto plot = [&](int x, int y, float coverage) {
+        if (coverage <= 0.0f || !is_inside(x, y, scissor) || !early_test<features>(x, y, point.z, state)) return;
+
+        Fragment fragment {
+            { static_cast<float>(x), static_cast<float>(y), point.z, 1.0f },
+            attribute,
+            {},
+            {},
+        };
+        shade_fragment<features>(fragment, uniforms, fs, coverage);
+    };
+
+    if (!state.antialiasing) {
+        plot(std::floor(point.x), std::floor(point.y), 1.0f);
+        return;
+    }
+
+    // the point is spread over the four closest pixels, weighted by the
+    // distance to their centers
+    float x = point.x - 0.5f;
+    float y = point.y - 0.5f;
+    int x0 = std::floor(x);
+    int y0 = std::floor(y);
+    float fraction_x = x - x0;
+    float fraction_y = y - y0;
+
+    plot(x0,     y0,     (1.0f - fraction_x) * (1.0f - fraction_y));
+    plot(x0 + 1, y0,     fraction_x * (1.0f - fraction_y));
+    plot(x0,     y0 + 1, (1.0f - fraction_x) * fraction_y);
+    plot(x0 + 1, y0 + 1, fraction_x * fraction_y);
+}
+
+void Rasterizer::light_tile(size_t tile, std::span<const PointLight> lights, const Mat& inverse_view_projection,
+                            Color ambient, std::span<const SurfaceMaterial> materials) {
+
+    int tiles_x = (m_viewport_width + lighting_tile_size - 1) / lighting_tile_size;
+    int min_x = tile % tiles_x * lighting_tile_size;
+    int min_y = tile / tiles_x * lighting_tile_size;
+    int max_x = std::min(min_x + lighting_tile_size, m_viewport_width) - 1;
+    int max_y = std::min(min_y + lighting_tile_size, m_viewport_height) - 1;
+
+    const auto& normals = m_framebuffer.get_attachment(GBuffer::Normal).get<Half4>();
+    const auto& albedos = m_framebuffer.get_attachment(GBuffer::Albedo).get<Color>();
+    const auto& material_ids = m_framebuffer.get_attachment(GBuffer::Material).get<uint8_t>();
+
+    float min_depth = std::numeric_limits<float>::max();
+    float max_depth = std::numeric_limits<float>::lowest();
+    for (int y = min_y; y <= max_y; ++y) {
+        for (int x = min_x; x <= max_x; ++x) {
+            float depth = m_framebuffer.get_depth(x, y);
+            if (depth == Framebuffer::cleared_depth) continue;
+            min_depth = std::min(min_depth, depth);
+            max_depth = std::max(max_depth, depth);
+        }
+    }
+
+    // nothing to light
+    if (min_depth > max_depth) return;
+
+    // the volume between the closest and furthest surface is bounded by the
+    // corners of the tile at both depths
+    Aabb volume;
+    for (float depth : { min_depth, max_depth }) {
+        volume.extend(unproject(min_x, min_y, depth, inverse_view_projection));
+        volume.extend(unproject(max_x + 1, min_y, depth, inverse_view_projection));
+        volume.extend(unproject(min_x, max_y + 1, depth, inverse_view_projection));
+        volume.extend(unproject(max_x + 1, max_y + 1, depth, inverse_view_projection));
+    }
+
+    Arena& arena = m_frame_arena.get(get_thread_index());
+    auto tile_lights = arena.allocate<uint32_t>(lights.size());
+    size_t light_count = 0;
+
+    for (uint32_t i = 0; i < lights.size(); ++i) {
+        if (Sphere { lights[i].position, lights[i].radius }.intersects(volume)) {
+            tile_lights[light_count++] = i;
+        }
+    }
+
+    f32x4 ambient_light = to_f32x4(ambient) / 255.0f;
+
+    for (int y = min_y; y <= max_y; ++y) {
+        for (int x = min_x; x <= max_x; ++x) {
+            float depth = m_framebuffer.get_depth(x, y);
+            if (depth == Framebuffer::cleared_depth) continue;
+
+            // lighting is evaluated at the pixel center, where the surface was sampled
+            Vec position = unproject(x + 0.5f, y + 0.5f, depth, inverse_view_projection);
+            Vec normal = normals.get(x, y).to_vec();
+            f32x4 light {};
+
+            SurfaceMaterial material;
+            if (!materials.empty()) {
+                // any fragment shader can write the id, so ids past the
+                // materials are only a bug in debug builds
+                uint8_t id = material_ids.get(x, y);
+                assert(id < materials.size());
+                if (id < materials.size()) {
+                    material = materials[id];
+                }
+            }
+
+            for (auto index : tile_lights.first(light_count)) {
+                const PointLight& point_light = lights[index];
+                Vec to_light = point_light.position - position;
+                to_light.w = 0.0f;
+
+                float distance = to_light.length();
+                if (distance >= point_light.radius) continue;
+
+                float diffuse = distance > 0.0f ? std::max(normal.dot(to_light) / distance, 0.0f) : 1.0f;
+                float falloff = 1.0f - distance / point_light.radius;
+                float strength = point_light.intensity * diffuse * falloff * falloff / 255.0f;
+                light += to_f32x4(point_light.color) * strength;
+            }
+
+            light = ambient_light + light * material.diffuse + material.emission;
+            f32x4 result = to_f32x4(albedos.get(x, y)) * light;
+            for (int i = 0; i < 3; ++i) {
+                result[i] = std::min(result[i], 255.0f);
+            }
+            result[3] = 255.0f;
+
+            m_framebuffer.get_color_buffer().write(x, y, to_color(result));
+        }
+    }
+}
@@ -1,21 +1,116 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
 #include <ranges>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "Vec.h"
+#include "Bounds.h"
 #include "Color.h"
 #include "Framebuffer.h"
+#include "CommandBuffer.h"
+#include "Arena.h"
+#include "JobSystem.h"
+#include "Light.h"
 #include "types.h"
 
 class Rasterizer {
     Framebuffer& m_framebuffer;
-    // vertex winding order of front face triangles
-    WindingOrder m_winding_order = WindingOrder::CounterClockwise;
-    CullMode m_cull_mode = CullMode::None;
+    // size of the region in the top left corner of the framebuffer, which is rendered to
+    int m_viewport_width;
+    int m_viewport_height;
+    PipelineState m_state;
+    // runs the stages of submissions in parallel, if set
+    JobSystem* m_job_system = nullptr;
+
+    // transient memory, which is reset by begin_frame(), and by every draw outside of a frame
+    FrameArena m_frame_arena;
+
+    // processed vertices of the current draw or submission, allocated from the frame arena
+    std::span<Vec> m_vertices_vp;
+    std::span<Vec> m_attributes;
+    std::vector<uint32_t> m_sequential_indices;
+
+    // draw of a submitted command buffer, and the offset of its processed vertices
+    // every instance of an instanced draw is a draw of its own, with its own
+    // uniforms and level of detail
+    struct SubmittedDraw {
+        const DrawCommand* command;
+        std::span<const Vec> vertices;
+        // empty for non-indexed draws
+        std::span<const uint32_t> indices;
+        const Uniforms* uniforms;
+        // position in the submission, to keep sorting stable without a temporary buffer
+        uint32_t order;
+        // draws are only reordered within a segment, draws using the stencil
+        // get a segment of their own, as they depend on all previous draws
+        uint32_t segment;
+        uint32_t vertex_offset;
+        // index of the first triangle, counting the triangles of all previous draws
+        uint32_t triangle_offset;
+
+        // the vertices of quantized draws are only referenced by their command
+        [[nodiscard]] size_t get_vertex_count() const {
+            return command->quantized ? command->quantized->size() : vertices.size();
+        }
+    };
+
+    // visible triangle of a submitted draw, referencing the processed vertices
+    // the triangles of every batch are at the start of its range of the triangles
+    struct BinnedTriangle {
+        uint32_t draw;
+        uint32_t a, b, c;
+        // range of overlapped tiles
+        uint16_t tile_min_x, tile_min_y, tile_max_x, tile_max_y;
+    };
+
+    // submissions are rasterized in square tiles of this size
+    static constexpr int tile_size = 64;
+    // instances are drawn with a level of detail whose triangles cover this many pixels on average
+    static constexpr float instance_lod_pixels_per_triangle = 4.0f;
+    // commands of immediate draws, which are rendered through a submission
+    CommandBuffer m_immediate_commands;
+    // amount of vertices and triangles processed by a single job
+    static constexpr size_t vertex_batch_size = 1024;
+    static constexpr size_t triangle_batch_size = 1024;
+    std::span<SubmittedDraw> m_draws;
+    std::span<BinnedTriangle> m_triangles;
+    // triangle indices overlapping every tile, in submission order
+    // the bin of tile i is m_bin_triangles[m_bin_offsets[i]] up to m_bin_triangles[m_bin_offsets[i+1]]
+    std::span<uint32_t> m_bin_offsets;
+    std::span<uint32_t> m_bin_triangles;
+
+    // retained mode only redraws tiles whose overlapping draws have changed
+    bool m_retained = false;
+    // hashes of the submitted draws, and of the draws overlapping every tile in the last submission
+    std::span<uint64_t> m_draw_hashes;
+    std::vector<uint64_t> m_tile_hashes;
+    // framebuffer generation at the last retained frame
+    uint64_t m_retained_generation = 0;
+    size_t m_redrawn_tile_count = 0;
+    // draws submitted since begin_frame(), which are rendered by end_frame() in retained mode
+    bool m_frame_active = false;
+    CommandBuffer m_frame_commands;
+
+    // visible pixels of the proxies tested since begin_query()
+    bool m_query_active = false;
+    size_t m_query_samples = 0;
 
 public:
-    explicit Rasterizer(Framebuffer& framebuffer) : m_framebuffer(framebuffer) {
+    explicit Rasterizer(Framebuffer& framebuffer)
+        : m_framebuffer(framebuffer)
+        , m_viewport_width(framebuffer.get_width())
+        , m_viewport_height(framebuffer.get_height())
+    {
         m_framebuffer.clear();
     }
 
@@ -23,37 +118,316 @@ public:
         return m_framebuffer;
     }
 
+    [[nodiscard]] int get_viewport_width() const {
+        return m_viewport_width;
+    }
+
+    [[nodiscard]] int get_viewport_height() const {
+        return m_viewport_height;
+    }
+
+    // renders to the top left width x height pixels of the framebuffer, so that
+    // the render resolution can change from frame to frame without reallocating
+    // the framebuffer, ndc are mapped to the viewport, pixels outside of it are not touched
+    void set_viewport(int width, int height) {
+        assert(width > 0 && width <= m_framebuffer.get_width());
+        assert(height > 0 && height <= m_framebuffer.get_height());
+
+        if (width == m_viewport_width && height == m_viewport_height) return;
+
+        m_viewport_width = width;
+        m_viewport_height = height;
+        // retained tiles don't match the new viewport
+        m_tile_hashes.clear();
+    }
+
+    [[nodiscard]] FrameArena& get_frame_arena() {
+        return m_frame_arena;
+    }
+
+    [[nodiscard]] JobSystem* get_job_system() const {
+        return m_job_system;
+    }
+
+    // the frame arena gets an arena for every worker of the job system, so that
+    // jobs can allocate from get_frame_arena().get(job_system->get_thread_index())
+    // inside of frames, see begin_frame()
+    // the job system has to outlive the rasterizer, nullptr runs everything on the calling thread
+    void set_job_system(JobSystem* job_system) {
+        m_job_system = job_system;
+        m_frame_arena.set_thread_count(job_system ? job_system->get_thread_count() : 1);
+        m_tile_fragments.resize(m_frame_arena.get_thread_count());
+    }
+
+    // all of the state set below, e.g. for recording command buffers with it
+    [[nodiscard]] PipelineState get_state() const {
+        return m_state;
+    }
+
     [[nodiscard]] CullMode get_cull_mode() const {
-        return m_cull_mode;
+        return m_state.cull_mode;
     }
 
     void set_cull_mode(CullMode cull_mode) {
-        m_cull_mode = cull_mode;
+        m_state.cull_mode = cull_mode;
     }
 
     [[nodiscard]] WindingOrder get_winding_order() const {
-        return m_winding_order;
+        return m_state.winding_order;
     }
 
     void set_winding_order(WindingOrder winding_order) {
-        m_winding_order = winding_order;
+        m_state.winding_order = winding_order;
+    }
+
+    [[nodiscard]] PolygonMode get_polygon_mode() const {
+        return m_state.polygon_mode;
+    }
+
+    void set_polygon_mode(PolygonMode polygon_mode) {
+        m_state.polygon_mode = polygon_mode;
+    }
+
+    [[nodiscard]] bool get_antialiasing() const {
+        return m_state.antialiasing;
+    }
+
+    void set_antialiasing(bool antialiasing) {
+        m_state.antialiasing = antialiasing;
+    }
+
+    [[nodiscard]] StencilState get_stencil() const {
+        return m_state.stencil;
+    }
+
+    void set_stencil(StencilState stencil) {
+        m_state.stencil = stencil;
+    }
+
+    [[nodiscard]] bool get_depth_test() const {
+        return m_state.depth_test;
+    }
+
+    void set_depth_test(bool depth_test) {
+        m_state.depth_test = depth_test;
+    }
+
+    [[nodiscard]] bool get_depth_write() const {
+        return m_state.depth_write;
+    }
+
+    void set_depth_write(bool depth_write) {
+        m_state.depth_write = depth_write;
+    }
+
+    [[nodiscard]] bool get_color_write() const {
+        return m_state.color_write;
+    }
+
+    void set_color_write(bool color_write) {
+        m_state.color_write = color_write;
+    }
+
+    [[nodiscard]] bool get_blending() const {
+        return m_state.blending;
+    }
+
+    void set_blending(bool blending) {
+        m_state.blending = blending;
+    }
+
+    [[nodiscard]] bool is_transparent() const {
+        return m_state.transparent;
+    }
+
+    // immediate transparent draws are rendered as a submission of their own, so
+    // their fragments are sorted among themselves, immediate lines and points
+    // are blended directly
+    void set_transparent(bool transparent) {
+        m_state.transparent = transparent;
+    }
+
+    [[nodiscard]] bool is_retained() const {
+        return m_retained;
+    }
+
+    // in retained mode the framebuffer is not cleared between frames, instead
+    // every frame clears and redraws only the tiles overlapped by draws that
+    // changed, appeared or disappeared since the last frame, all other tiles
+    // keep their pixels
+    // all submissions and triangle draws between begin_frame() and end_frame()
+    // are collected, and rendered as a single submission by end_frame(), so
+    // their vertices, indices, meshes and instances have to stay alive until then
+    // lines, points, single triangles and depth passes write the framebuffer
+    // directly, and can't be retained
+    // draws are compared by their hash, vertex data is identified by its address,
+    // so changing it in place requires clearing the framebuffer, which redraws everything
+    void set_retained(bool retained) {
+        assert(!m_frame_active);
+        m_retained = retained;
+        m_tile_hashes.clear();
+    }
+
+    // without retained mode, draws are rendered right away, and frames only
+    // mark where they begin and end, so the same code renders either way
+    // allocations from the frame arena stay valid until the next begin_frame()
+    void begin_frame() {
+        assert(!m_frame_active);
+        m_frame_active = true;
+        m_frame_commands.reset();
+        m_frame_arena.reset();
+    }
+
+    void end_frame();
+
+    // amount of tiles rasterized by the last submission
+    [[nodiscard]] size_t get_redrawn_tile_count() const {
+        return m_redrawn_tile_count;
+    }
+
+    // amount of draws of the last submission, every instance inside of the view
+    // frustum counts as a draw of its own
+    [[nodiscard]] size_t get_submitted_draw_count() const {
+        return m_draws.size();
     }
 
 public:
     void render_vertex_buffer(std::span<const Vec> vertices, VertexShader vs, FragmentShader fs) {
+        render_vertex_buffer(vertices, Uniforms {}, vs, fs);
+    }
 
-        assert(vertices.size() % 3 == 0);
-        for (auto&& [idx, verts] : vertices | std::views::chunk(3) | std::views::enumerate) {
+    // attributes is either empty, or holds one attribute per vertex, which is
+    // interpolated and passed to the fragment shader
+    void render_vertex_buffer(std::span<const Vec> vertices, const Uniforms& uniforms, VertexShader vs,
+                              FragmentShader fs, std::span<const Vec> attributes = {}) {
+        render_triangles(vertices, {}, uniforms, vs, fs, attributes);
+    }
 
-            assert(verts.size() == 3);
-            const Vec& a = verts[0];
-            const Vec& b = verts[1];
-            const Vec& c = verts[2];
+    // multi-target shaders write to any of the attachments of the framebuffer in a single pass
+    void render_vertex_buffer(std::span<const Vec> vertices, const Uniforms& uniforms, VertexShader vs,
+                              MultiTargetShader mts, std::span<const Vec> attributes = {}) {
+        render_triangles(vertices, {}, uniforms, vs, mts, attributes);
+    }
 
-            draw_triangle(a, b, c, vs, fs);
-        }
+    // renders a triangle list, where every 3 indices reference the vertices of a triangle
+    void render_indexed(std::span<const Vec> vertices, std::span<const uint32_t> indices,
+                        const Uniforms& uniforms, VertexShader vs, FragmentShader fs,
+                        std::span<const Vec> attributes = {}) {
+        render_triangles(vertices, indices, uniforms, vs, fs, attributes);
+    }
+
+    void render_indexed(std::span<const Vec> vertices, std::span<const uint32_t> indices,
+                        const Uniforms& uniforms, VertexShader vs, MultiTargetShader mts,
+                        std::span<const Vec> attributes = {}) {
+        render_triangles(vertices, indices, uniforms, vs, mts, attributes);
+    }
+
+    // the vertices are decoded while they are processed, see CommandBuffer::draw_indexed()
+    void render_indexed(const QuantizedVertices& vertices, std::span<const uint32_t> indices,
+                        const Uniforms& uniforms, VertexShader vs, FragmentShader fs) {
+        m_immediate_commands.reset();
+        m_immediate_commands.set_state(m_state);
+        m_immediate_commands.draw_indexed(vertices, indices, uniforms, vs, fs);
+        submit(m_immediate_commands);
+    }
+
+    void render_indexed(const QuantizedVertices& vertices, std::span<const uint32_t> indices,
+                        const Uniforms& uniforms, VertexShader vs, MultiTargetShader mts) {
+        m_immediate_commands.reset();
+        m_immediate_commands.set_state(m_state);
+        m_immediate_commands.draw_indexed(vertices, indices, uniforms, vs, mts);
+        submit(m_immediate_commands);
+    }
+
+    // draws the mesh once for every model matrix in a single submission, see
+    // CommandBuffer::draw_instanced()
+    void render_instanced(const Mesh& mesh, std::span<const Mat> instances, const Uniforms& uniforms,
+                          VertexShader vs, FragmentShader fs) {
+        m_immediate_commands.reset();
+        m_immediate_commands.set_state(m_state);
+        m_immediate_commands.draw_instanced(mesh, instances, uniforms, vs, fs);
+        submit(m_immediate_commands);
+    }
+
+    // depth-only pass for shadow maps, the triangles are rasterized into the depth
+    // buffer without running a fragment shader or touching the color buffer
+    // the viewport covers the whole depth buffer, which may have any size
+    void render_depth(std::span<const Vec> vertices, std::span<const uint32_t> indices,
+                      const Uniforms& uniforms, VertexShader vs, DepthBuffer& depth_buffer);
+
+    // depth pre-pass into the depth buffer of the framebuffer, the stencil is left untouched
+    // produces the same depths as a color pass, so later passes can test against them
+    void render_depth(std::span<const Vec> vertices, std::span<const uint32_t> indices,
+                      const Uniforms& uniforms, VertexShader vs);
+
+    // occlusion queries count the pixels of proxy geometry, like the bounding box of
+    // an expensive mesh, which pass the depth test against the depth buffer of the
+    // framebuffer, nothing is written, so the result can decide whether to draw the
+    // mesh in the next frame, after the occluders have been drawn
+    void begin_query() {
+        assert(!m_query_active);
+        m_query_active = true;
+        m_query_samples = 0;
     }
 
+    // adds the visible pixels of the box, transformed by the mvp of the uniforms, to the query
+    // boxes which are too far outside of the viewport to be rasterized are
+    // conservatively counted as covering the whole viewport
+    void query_box(const Aabb& box, const Uniforms& uniforms) {
+        assert(m_query_active);
+        m_query_samples += count_visible_samples(box, uniforms, false);
+    }
+
+    // returns the amount of visible pixels of the proxies tested since begin_query()
+    [[nodiscard]] size_t end_query() {
+        assert(m_query_active);
+        m_query_active = false;
+        return m_query_samples;
+    }
+
+    // like a query of a single box, but stops at the first visible pixel
+    [[nodiscard]] bool is_box_visible(const Aabb& box, const Uniforms& uniforms) {
+        return count_visible_samples(box, uniforms, true) > 0;
+    }
+
+    // writes the index of every triangle which survives face culling, and is not
+    // degenerate to visible, which has to hold one entry per triangle
+    // returns the amount of visible triangles
+    size_t cull_triangles(std::span<const Vec> vertices_vp, std::span<const uint32_t> indices,
+                          std::span<uint32_t> visible) const {
+        return cull_triangles(vertices_vp, indices, m_state, visible);
+    }
+
+    static size_t cull_triangles(std::span<const Vec> vertices_vp, std::span<const uint32_t> indices,
+                                 PipelineState state, std::span<uint32_t> visible);
+
+    // renders the draws recorded into the command buffers
+    // draws are reordered by their state, but draws with equal state keep their
+    // recording order, draws using the stencil are never moved across other draws, all vertices are processed before the triangles are binned
+    // into screen tiles, which are then rasterized independently of each other
+    // with a job system, every stage is run in parallel, and waits for the previous one
+    // in retained mode, the draws are only rendered by end_frame()
+    void submit(std::span<const CommandBuffer* const> command_buffers);
+
+    void submit(const CommandBuffer& command_buffer) {
+        const CommandBuffer* command_buffers[] { &command_buffer };
+        submit(command_buffers);
+    }
+
+    // lighting pass of deferred shading, lights every pixel holding a surface,
+    // and writes the result to the color buffer
+    // the surfaces are read from the g-buffer attachments of the framebuffer,
+    // which are written by a multi-target shader in the geometry pass
+    // light positions and surface normals are in the space which view_projection
+    // transforms to ndc, the screen is lit in tiles, which only consider the
+    // lights reaching the volume between their closest and furthest surface
+    // the material id of every pixel selects one of the materials, which have
+    // to cover all ids written by the geometry pass, without materials every
+    // surface is lit with the default material, as are ids past the materials
+    // in release builds
+    void shade_deferred(std::span<const PointLight> lights, const Mat& view_projection,
+                        Color ambient = Color::black(), std::span<const SurfaceMaterial> materials = {});
+
     //
     //                (y)
     //                 1 (-z)
@@ -68,10 +442,289 @@ public:
     //             1  -1
     //            (z)(-y)
     //
-    void draw_triangle(Vec a_ndc, Vec b_ndc, Vec c_ndc, VertexShader vs, FragmentShader fs);
+    void draw_triangle(Vec a_ndc, Vec b_ndc, Vec c_ndc, const Uniforms& uniforms, VertexShader vs, FragmentShader fs);
+
+    // lines and points are depth tested, and not affected by face culling
+    void draw_line(Vec a_ndc, Vec b_ndc, const Uniforms& uniforms, VertexShader vs, FragmentShader fs,
+                   std::span<const Vec> attributes = {});
+
+    void draw_points(std::span<const Vec> points, const Uniforms& uniforms, VertexShader vs, FragmentShader fs,
+                     std::span<const Vec> attributes = {});
 
 private:
-    void rasterize_pixel(Vec p, Vec a_vp, Vec b_vp, Vec c_vp, FragmentShader fs);
+    // called before a draw allocates from the frame arena, draws outside of a
+    // frame only need their own allocations, so the arena is reset for each of them
+    void sync_frame_arena() {
+        if (!m_frame_active) {
+            m_frame_arena.reset();
+        }
+    }
+
+    // runs function(begin, end) on batches of the range [0, count), in parallel if a job system is set
+    template <typename F>
+    void for_each_batch(size_t count, size_t batch_size, F&& function) {
+        if (m_job_system) {
+            m_job_system->parallel_for(count, batch_size, function);
+            return;
+        }
+
+        for (size_t begin = 0; begin < count; begin += batch_size) {
+            function(begin, std::min(begin + batch_size, count));
+        }
+    }
+
+    // index of the per-worker data (e.g. the arenas of the frame arena) of the
+    // calling thread, the rasterizer may be driven by a worker of another job system
+    [[nodiscard]] size_t get_thread_index() const {
+        return m_job_system ? m_job_system->get_thread_index() : 0;
+    }
+
+    void allocate_vertices(size_t count) {
+        m_vertices_vp = m_frame_arena.get().allocate<Vec>(count);
+        m_attributes = m_frame_arena.get().allocate<Vec>(count);
+    }
+
+    // jobs may only call this with counts, which have been requested before
+    [[nodiscard]] std::span<const uint32_t> get_sequential_indices(size_t count) {
+        // non-indexed triangle lists share the same trivial index buffer
+        if (m_sequential_indices.size() < count) {
+            m_sequential_indices.resize(count);
+            std::iota(m_sequential_indices.begin(), m_sequential_indices.end(), 0);
+        }
+        return std::span(m_sequential_indices).first(count);
+    }
+
+    // runs the vertex shader on every vertex, and transforms the results to a viewport of the given size
+    // the default vertex shader is a plain matrix transform, which is done with 4-wide vectors instead
+    static void shade_vertices(std::span<const Vec> vertices, const Uniforms& uniforms, VertexShader vs,
+                               std::span<Vec> vertices_vp, int width, int height);
+
+    // runs the vertex shader on every vertex, and transforms the results to the viewport
+    // the results are written to the processed vertices, starting at offset
+    void process_vertices(std::span<const Vec> vertices, std::span<const Vec> attributes,
+                          const Uniforms& uniforms, VertexShader vs, size_t offset = 0);
+
+    // processes the vertices of an immediate draw, in batches
+    void process_draw_vertices(std::span<const Vec> vertices, std::span<const Vec> attributes,
+                               const Uniforms& uniforms, VertexShader vs);
+
+    // writes a draw for every instance of an instanced command which is inside
+    // of the view frustum, returns the amount of written draws
+    size_t setup_instances(const DrawCommand& command, std::span<SubmittedDraw> draws, uint32_t order, uint32_t segment);
+
+    // decodes and processes count quantized vertices starting at first, the
+    // results are written to the processed vertices, starting at offset
+    // the default vertex shader is folded into the decoding, whose depths aren't
+    // bit-identical to those of decoded vertices, unless the mvp is the identity
+    void process_quantized_vertices(const QuantizedVertices& vertices, size_t first, size_t count,
+                                    const Uniforms& uniforms, VertexShader vs, size_t offset);
+
+    // processes the range [begin, end) of the vertices of all submitted draws
+    void process_submitted_vertices(size_t begin, size_t end);
+
+    // culls the range [begin, end) of the triangles of all submitted draws, the
+    // ones covering pixels are written to the triangles, starting at begin, and
+    // counted in the tiles they overlap
+    // returns the amount of written triangles
+    size_t setup_submitted_triangles(size_t begin, size_t end, std::span<uint32_t> visible,
+                                     std::span<uint32_t> tile_counts);
+
+    // sorts the triangles of the submitted draws into screen tiles, given the
+    // amount of triangles written by every batch, and their counts in every tile,
+    // which are overwritten
+    void bin_triangles(std::span<const uint32_t> visible_counts, std::span<uint32_t> batch_cursors);
+
+    // returns false if a retained tile is unchanged, and was skipped
+    bool rasterize_tile(size_t tile, bool redraw);
+
+    // lighting pass tiles are smaller than raster tiles, for tighter depth bounds
+    static constexpr int lighting_tile_size = 16;
+
+    void light_tile(size_t tile, std::span<const PointLight> lights, const Mat& inverse_view_projection,
+                    Color ambient, std::span<const SurfaceMaterial> materials);
+
+    // inverse of the view projection and viewport transform
+    [[nodiscard]] Vec unproject(float x, float y, float depth, const Mat& inverse_view_projection) const {
+        Vec ndc {
+            x / m_viewport_width * 2 - 1,
+            1 - y / m_viewport_height * 2,
+            depth,
+            1.0f,
+        };
+        Vec position = inverse_view_projection * ndc;
+        return position / position.w;
+    }
+
+    // empty indices draw the vertices in order, like CommandBuffer::draw()
+    void render_triangles(std::span<const Vec> vertices, std::span<const uint32_t> indices,
+                          const Uniforms& uniforms, VertexShader vs, FragmentStage fs,
+                          std::span<const Vec> attributes);
+
+    // renders the command buffers right away, see submit()
+    void render_submission(std::span<const CommandBuffer* const> command_buffers);
+
+    void draw_triangles(std::span<const uint32_t> indices, const Uniforms& uniforms, FragmentStage fs);
+
+    // per-triangle values needed for shading its pixels
+    struct TriangleSetup {
+        Vec a, b, c;
+        Vec attribute_a, attribute_b, attribute_c;
+        Vec attribute_dx, attribute_dy;
+    };
+
+    struct PixelBounds {
+        int min_x, min_y, max_x, max_y;
+    };
+
+    // fragment of a transparent draw, the fragments of every pixel are a list
+    struct TransparentFragment {
+        Color color;
+        float depth;
+        TransparentFragment* next;
+    };
+
+    // lists of the tile a worker is rasterizing, allocated from its frame arena
+    // only set up if the tile is overlapped by transparent draws
+    struct TileFragments {
+        PixelBounds bounds;
+        std::span<TransparentFragment*> lists;
+        std::span<uint8_t> counts;
+    };
+
+    // one per worker
+    std::vector<TileFragments> m_tile_fragments = std::vector<TileFragments>(1);
+
+    // pixels keep the closest fragments up to this amount, further fragments are
+    // blended into the color buffer as they arrive, which is only correct if
+    // they arrive back to front
+    static constexpr uint8_t max_transparent_fragments = 8;
+
+    // adds a fragment to the list of its pixel, in the tile of the calling worker
+    void store_transparent_fragment(int x, int y, Color color, float depth);
+
+    // blends the lists of a tile back to front, over the opaque surfaces behind them
+    void resolve_transparent_fragments(const TileFragments& tile);
+
+    [[nodiscard]] PixelBounds get_viewport_bounds() const {
+        return { 0, 0, m_viewport_width - 1, m_viewport_height - 1 };
+    }
+
+    // pipeline state which is checked for every fragment, the raster functions are
+    // instantiated for every combination, so that it is resolved at compile time
+    // face culling is already applied during triangle setup, and the polygon mode
+    // is only checked once per primitive
+    struct RasterFeatures {
+        bool depth_test;
+        bool depth_write;
+        bool stencil;
+        bool color_write;
+        bool blending;
+        bool multi_target;
+        bool transparent;
+    };
+
+    static constexpr size_t raster_feature_count = 1 << 7;
+
+    // blending only applies to colors returned by a fragment shader, and most
+    // state doesn't apply to transparent fragments, indices which only differ in
+    // it share the same instantiation
+    [[nodiscard]] static constexpr RasterFeatures get_raster_features(size_t index) {
+        RasterFeatures features {
+            static_cast<bool>(index & 1 << 0),
+            static_cast<bool>(index & 1 << 1),
+            static_cast<bool>(index & 1 << 2),
+            static_cast<bool>(index & 1 << 3),
+            static_cast<bool>(index & 1 << 4),
+            static_cast<bool>(index & 1 << 5),
+            static_cast<bool>(index & 1 << 6),
+        };
+        features.blending = features.blending && features.color_write && !features.multi_target;
+        if (features.transparent) {
+            features.depth_test = true;
+            features.depth_write = false;
+            features.blending = false;
+            features.multi_target = false;
+        }
+        return features;
+    }
+
+    [[nodiscard]] static size_t get_raster_feature_index(const PipelineState& state, FragmentStage fs) {
+        return static_cast<size_t>(state.depth_test) << 0
+             | static_cast<size_t>(state.depth_write) << 1
+             | static_cast<size_t>(state.stencil.enabled) << 2
+             | static_cast<size_t>(state.color_write) << 3
+             | static_cast<size_t>(state.blending) << 4
+             | static_cast<size_t>(fs.mts != nullptr) << 5
+             | static_cast<size_t>(state.transparent) << 6;
+    }
+
+    // calls function.template operator()<features>() with the raster features of
+    // the state, through a table holding an instantiation for every combination
+    // meant to be called once per draw, with the loop over its primitives inside of function
+    template <typename F>
+    static void dispatch_raster_features(const PipelineState& state, FragmentStage fs, F&& function) {
+        using Function = std::remove_reference_t<F>;
+
+        static constexpr auto table = []<size_t... I>(std::index_sequence<I...>) {
+            return std::array<void (*)(Function&), sizeof...(I)> {
+                [](Function& function) { function.template operator()<get_raster_features(I)>(); }...
+            };
+        }(std::make_index_sequence<raster_feature_count>());
+
+        table[get_raster_feature_index(state, fs)](function);
+    }
+
+    // the vertices are indices into the processed vertices, only pixels inside of
+    // the scissor rectangle are rasterized
+    template <RasterFeatures features>
+    void rasterize_triangle(uint32_t a, uint32_t b, uint32_t c, const Uniforms& uniforms,
+                            FragmentStage fs, PixelBounds scissor, const PipelineState& state);
+
+    // shades a pixel covered by the triangle, the weights are its barycentric coordinates
+    template <RasterFeatures features>
+    void rasterize_pixel(int x, int y, float weight_a, float weight_b, float weight_c,
+                         const TriangleSetup& triangle, const Uniforms& uniforms, FragmentStage fs,
+                         const PipelineState& state);
+
+    // rasterizes a triangle according to the polygon mode of the state
+    template <RasterFeatures features>
+    void rasterize_primitive(uint32_t a, uint32_t b, uint32_t c, const Uniforms& uniforms,
+                             FragmentStage fs, PixelBounds scissor, const PipelineState& state);
+
+    // steps along the major axis of the line, so the cost only depends on the
+    // length of the part inside of the scissor rectangle
+    template <RasterFeatures features>
+    void rasterize_line(uint32_t a, uint32_t b, const Uniforms& uniforms, FragmentStage fs,
+                        PixelBounds scissor, const PipelineState& state);
+
+    template <RasterFeatures features>
+    void rasterize_point(uint32_t a, const Uniforms& uniforms, FragmentStage fs,
+                         PixelBounds scissor, const PipelineState& state);
+
+    // depth and stencil test of a fragment, run before it is shaded
+    // updates the stored stencil value according to the outcome of both tests
+    template <RasterFeatures features>
+    [[nodiscard]] bool early_test(int x, int y, float depth, const PipelineState& state);
+
+    // runs the fragment shader, and blends the result into the framebuffer
+    // coverage scales the alpha of the color, partially covered pixels don't write their depth
+    // render targets of multi-target shaders can't be blended, they are written
+    // if at least half of the pixel is covered
+    template <RasterFeatures features>
+    void shade_fragment(const Fragment& fragment, const Uniforms& uniforms, FragmentStage fs,
+                        float coverage = 1.0f);
+
+    [[nodiscard]] static bool is_inside(int x, int y, PixelBounds bounds) {
+        return x >= bounds.min_x && x <= bounds.max_x && y >= bounds.min_y && y <= bounds.max_y;
+    }
+
+    // checks if triangles with a positive (clockwise in the viewport) or negative
+    // signed area pass face culling
+    [[nodiscard]] static std::tuple<bool, bool> get_culling_by_area_sign(PipelineState state) {
+        auto [cw_front, cw_back] = get_faces_from_winding_order(state.winding_order, true, false);
+        auto [ccw_front, ccw_back] = get_faces_from_winding_order(state.winding_order, false, true);
+        return { apply_culling(state.cull_mode, cw_front, cw_back), apply_culling(state.cull_mode, ccw_front, ccw_back) };
+    }
 
     // returns the area of a triangle, which may be negative
     [[nodiscard]] static constexpr float triangle_signed_area(Vec a, Vec b, Vec c) {
@@ -80,32 +733,117 @@ private:
 
     // transforms coordinates from NDC to the actual viewport
     [[nodiscard]] Vec viewport_transform(Vec v) const {
+        return viewport_transform(v, m_viewport_width, m_viewport_height);
+    }
+
+    [[nodiscard]] static Vec viewport_transform(Vec v, int width, int height) {
         return {
-            ((v.x + 1) / 2) * m_framebuffer.get_width(),
-            (-(v.y - 1) / 2) * m_framebuffer.get_height(),
+            ((v.x + 1) / 2) * width,
+            (-(v.y - 1) / 2) * height,
             v.z,
             v.w
         };
 
     }
 
-    [[nodiscard]] Rectangle get_triangle_aabb(Vec a, Vec b, Vec c) {
+    // viewport coordinates are snapped to a fixed point grid with 8 bits of
+    // sub-pixel precision, which makes the edge functions exact
+    static constexpr int subpixel_bits = 8;
+    static constexpr int32_t subpixel_scale = 1 << subpixel_bits;
+    // triangles with vertices further away from the viewport would overflow the
+    // edge functions, and are dropped until clipping is implemented
+    static constexpr float guard_band = 1 << 14;
+
+    struct FixedPoint {
+        int32_t x, y;
+    };
+
+    [[nodiscard]] static bool is_inside_guard_band(Vec v) {
+        return std::abs(v.x) <= guard_band && std::abs(v.y) <= guard_band;
+    }
+
+    [[nodiscard]] static FixedPoint snap_to_grid(Vec v) {
+        // rounds to nearest, std::lround is an out of line call
+        auto round = [](float value) {
+            return static_cast<int32_t>(value + (value >= 0.0f ? 0.5f : -0.5f));
+        };
+        return { round(v.x * subpixel_scale), round(v.y * subpixel_scale) };
+    }
+
+    // integer version of triangle_signed_area()
+    [[nodiscard]] static constexpr int64_t edge_function(FixedPoint a, FixedPoint b, FixedPoint p) {
+        return static_cast<int64_t>(b.x-a.x)*(p.y-a.y) - static_cast<int64_t>(b.y-a.y)*(p.x-a.x);
+    }
+
+    // top-left fill rule: pixel centers exactly on an edge are only covered if the
+    // edge is a top or left edge, so pixels on shared edges are drawn exactly once
+    // assumes a positive triangle area
+    [[nodiscard]] static constexpr int64_t get_fill_bias(FixedPoint a, FixedPoint b) {
+        int32_t dx = b.x - a.x;
+        int32_t dy = b.y - a.y;
+        bool top = dy == 0 && dx > 0;
+        bool left = dy < 0;
+        return top || left ? 0 : -1;
+    }
 
-        Rectangle aabb;
+    // returns the range of pixels whose centers may be covered by the triangle,
+    // clamped to the scissor rectangle, as partially visible triangles are not clipped yet
+    [[nodiscard]] static PixelBounds get_triangle_bounds(FixedPoint a, FixedPoint b, FixedPoint c, PixelBounds scissor) {
+        constexpr int32_t half = subpixel_scale / 2;
 
-        aabb.x = std::min({a.x, b.x, c.x});
-        aabb.y = std::min({a.y, b.y, c.y});
-        aabb.width = std::max({a.x, b.x, c.x});
-        aabb.height = std::max({a.y, b.y, c.y});
+        // the first and last pixel center inside of [min, max]
+        auto first_pixel = [](int32_t min) {
+            return (min - half + subpixel_scale - 1) >> subpixel_bits;
+        };
+        auto last_pixel = [](int32_t max) {
+            return (max - half) >> subpixel_bits;
+        };
 
-        assert(aabb.width <= m_framebuffer.get_width());
-        assert(aabb.height <= m_framebuffer.get_height());
+        return {
+            std::max(first_pixel(std::min({a.x, b.x, c.x})), scissor.min_x),
+            std::max(first_pixel(std::min({a.y, b.y, c.y})), scissor.min_y),
+            std::min(last_pixel(std::max({a.x, b.x, c.x})), scissor.max_x),
+            std::min(last_pixel(std::max({a.y, b.y, c.y})), scissor.max_y),
+        };
+    }
 
-        return aabb;
+    // returns the range of pixels touched by the edges or vertices of a triangle,
+    // with a margin of extra pixels around it
+    [[nodiscard]] static PixelBounds get_conservative_bounds(FixedPoint a, FixedPoint b, FixedPoint c,
+                                                             int margin, PixelBounds scissor) {
+        return {
+            std::max((std::min({a.x, b.x, c.x}) >> subpixel_bits) - margin, scissor.min_x),
+            std::max((std::min({a.y, b.y, c.y}) >> subpixel_bits) - margin, scissor.min_y),
+            std::min((std::max({a.x, b.x, c.x}) >> subpixel_bits) + margin, scissor.max_x),
+            std::min((std::max({a.y, b.y, c.y}) >> subpixel_bits) + margin, scissor.max_y),
+        };
     }
 
-    [[nodiscard]] bool apply_culling(bool front, bool back) const {
-        switch (m_cull_mode) {
+    // calls shade(x, y, e_a, e_b, e_c) for every pixel inside of the bounds whose
+    // center is covered by the triangle, with the edge functions at the center
+    // the triangle has to be oriented clockwise, with a positive area
+    template <typename F>
+    static void for_each_covered_pixel(FixedPoint a, FixedPoint b, FixedPoint c, PixelBounds bounds, F&& shade);
+
+    // minimal raster loop of depth-only passes, which only interpolates, tests
+    // and writes the depth, the target is either a depth or a depth-stencil buffer
+    template <typename T>
+    static void rasterize_depth_triangle(Vec a, Vec b, Vec c, Buffer<T>& target, PixelBounds scissor);
+
+    // the viewport is the top left width x height pixels of the target
+    template <typename T>
+    void render_depth_to(std::span<const Vec> vertices, std::span<const uint32_t> indices,
+                         const Uniforms& uniforms, VertexShader vs, Buffer<T>& target, int width, int height);
+
+    // rasterizes the faces of the box against the depth buffer, the faces facing
+    // towards and away from the viewer both cover its outline exactly once, and
+    // the front faces pass the depth test wherever the back faces do, so the
+    // larger count of both belongs to the front, whichever way the box is mirrored
+    // if early_out is set, the count is only zero or non-zero
+    [[nodiscard]] size_t count_visible_samples(const Aabb& box, const Uniforms& uniforms, bool early_out);
+
+    [[nodiscard]] static bool apply_culling(CullMode cull_mode, bool front, bool back) {
+        switch (cull_mode) {
             using enum CullMode;
             case Front: return back;
             case Back: return front;
@@ -114,11 +852,11 @@ private:
         }
     }
 
-    [[nodiscard]] std::tuple<bool, bool>
-    get_faces_from_winding_order(bool cw, bool ccw) const {
+    [[nodiscard]] static std::tuple<bool, bool>
+    get_faces_from_winding_order(WindingOrder winding_order, bool cw, bool ccw) {
 
         bool front, back;
-        switch (m_winding_order) {
+        switch (winding_order) {
             using enum WindingOrder;
 
             case Clockwise:
@@ -137,6 +875,36 @@ private:
         return {front, back};
     }
 
+    [[nodiscard]] static constexpr bool compare(CompareFunction function, uint8_t reference, uint8_t stored) {
+        switch (function) {
+            using enum CompareFunction;
+            case Never: return false;
+            case Less: return reference < stored;
+            case LessEqual: return reference <= stored;
+            case Equal: return reference == stored;
+            case NotEqual: return reference != stored;
+            case GreaterEqual: return reference >= stored;
+            case Greater: return reference > stored;
+            case Always: return true;
+            default: assert(!"invalid compare function");
+        }
+    }
+
+    [[nodiscard]] static constexpr uint8_t apply_stencil_op(StencilOp op, uint8_t stored, uint8_t reference) {
+        switch (op) {
+            using enum StencilOp;
+            case Keep: return stored;
+            case Zero: return 0;
+            case Replace: return reference;
+            case Invert: return ~stored;
+            case IncrementClamp: return stored == 0xff ? stored : stored + 1;
+            case DecrementClamp: return stored == 0 ? stored : stored - 1;
+            case IncrementWrap: return stored + 1;
+            case DecrementWrap: return stored - 1;
+            default: assert(!"invalid stencil op");
+        }
+    }
+
     [[nodiscard]] static constexpr Color blend_colors(Color src, Color dest) {
         // TODO: allow setting custom blend functions
         float factor_src = src.a / 255.0f;
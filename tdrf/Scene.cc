@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+
+#include "Scene.h"
+#include "Rasterizer.h"
+
+Scene::InstanceId Scene::add_instance(const Mesh& mesh, const Transform& transform,
+                                      FragmentShader* fs, VertexShader* vs) {
+
+    auto id = static_cast<InstanceId>(m_instances.size());
+
+    m_instances.push_back({
+        &mesh,
+        &transform,
+        vs,
+        fs,
+        mesh.aabb.transformed(transform.get_world()),
+        transform.get_version(),
+    });
+
+    m_needs_rebuild = true;
+    return id;
+}
+
+void Scene::update() {
+
+    if (m_needs_rebuild) {
+        rebuild();
+        return;
+    }
+
+    m_moved_leaves.clear();
+
+    for (InstanceId id = 0; id < m_instances.size(); ++id) {
+        Instance& instance = m_instances[id];
+        if (instance.transform_version == instance.transform->get_version()) continue;
+
+        instance.world_aabb = instance.mesh->aabb.transformed(instance.transform->get_world());
+        instance.transform_version = instance.transform->get_version();
+        m_moved_leaves.push_back(m_leaf_of[id]);
+    }
+
+    if (m_moved_leaves.empty()) return;
+
+    for (auto leaf : m_moved_leaves) {
+        refit(leaf);
+    }
+
+    if (m_nodes.front().aabb.surface_area() > 2.0f * m_built_area) {
+        rebuild();
+    }
+}
+
+void Scene::rebuild() {
+
+    m_nodes.clear();
+    m_order.resize(m_instances.size());
+    m_leaf_of.resize(m_instances.size());
+
+    for (InstanceId id = 0; id < m_instances.size(); ++id) {
+        Instance& instance = m_instances[id];
+        instance.world_aabb = instance.mesh->aabb.transformed(instance.transform->get_world());
+        instance.transform_version = instance.transform->get_version();
+        m_order[id] = id;
+    }
+
+    if (!m_instances.empty()) {
+        build_node(0, m_order.size(), 0);
+    }
+
+    m_built_area = m_nodes.empty() ? 0.0f : m_nodes.front().aabb.surface_area();
+    m_needs_rebuild = false;
+}
+
+uint32_t Scene::build_node(uint32_t first, uint32_t count, uint32_t parent) {
+
+    auto index = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back({});
+
+    Aabb aabb;
+    Aabb centroids;
+    for (uint32_t i = first; i < first + count; ++i) {
+        const Aabb& instance_aabb = m_instances[m_order[i]].world_aabb;
+        aabb.extend(instance_aabb);
+        centroids.extend(instance_aabb.center());
+    }
+
+    BvhNode node;
+    node.aabb = aabb;
+    node.parent = parent;
+
+    if (count <= max_leaf_size) {
+        node.first = first;
+        node.count = count;
+        for (uint32_t i = first; i < first + count; ++i) {
+            m_leaf_of[m_order[i]] = index;
+        }
+        m_nodes[index] = node;
+        return index;
+    }
+
+    // median split along the longest axis of the centroid bounds
+    Vec extent = centroids.extent();
+    int axis = 0;
+    if (extent.y > extent[axis]) axis = 1;
+    if (extent.z > extent[axis]) axis = 2;
+
+    auto begin = m_order.begin() + first;
+    auto middle = begin + count / 2;
+    std::nth_element(begin, middle, begin + count, [&](InstanceId a, InstanceId b) {
+        return m_instances[a].world_aabb.center()[axis] < m_instances[b].world_aabb.center()[axis];
+    });
+
+    uint32_t left_count = count / 2;
+    build_node(first, left_count, index);
+    node.right = build_node(first + left_count, count - left_count, index);
+
+    m_nodes[index] = node;
+    return index;
+}
+
+void Scene::refit(uint32_t node) {
+
+    {
+        BvhNode& leaf = m_nodes[node];
+        leaf.aabb = {};
+        for (uint32_t i = leaf.first; i < leaf.first + leaf.count; ++i) {
+            leaf.aabb.extend(m_instances[m_order[i]].world_aabb);
+        }
+    }
+
+    // propagate the new bounds up to the root
+    while (node != 0) {
+        node = m_nodes[node].parent;
+        BvhNode& parent = m_nodes[node];
+        parent.aabb = m_nodes[node + 1].aabb;
+        parent.aabb.extend(m_nodes[parent.right].aabb);
+    }
+}
+
+void Scene::cull(const Frustum& frustum, std::vector<InstanceId>& visible) const {
+
+    assert(!m_needs_rebuild && "Scene::update() has to be called before culling");
+    if (m_nodes.empty()) return;
+
+    std::array<uint32_t, 64> stack;
+    size_t stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        const BvhNode& node = m_nodes[stack[--stack_size]];
+
+        auto intersection = frustum.test(node.aabb);
+        if (intersection == Frustum::Intersection::Outside) continue;
+
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                InstanceId id = m_order[i];
+                // a fully contained leaf doesn't need to test its instances again
+                if (intersection == Frustum::Intersection::Inside ||
+                    frustum.test(m_instances[id].world_aabb) != Frustum::Intersection::Outside) {
+                    visible.push_back(id);
+                }
+            }
+            continue;
+        }
+
+        assert(stack_size + 2 <= stack.size());
+        uint32_t index = &node - m_nodes.data();
+        stack[stack_size++] = node.right;
+        stack[stack_size++] = index + 1;
+    }
+}
+
+size_t Scene::record(CommandBuffer& command_buffer, Mat view_projection, int viewport_width, int viewport_height) {
+
+    Frustum frustum(view_projection);
+
+    m_visible.clear();
+    cull(frustum, m_visible);
+
+    for (auto id : m_visible) {
+        const Instance& instance = m_instances[id];
+        auto uniforms = Uniforms::from_model(instance.transform->get_world(), view_projection);
+
+        float area = get_projected_area(instance, view_projection, viewport_width, viewport_height);
+        const IndexedMesh* lod = instance.mesh->select_lod(area, m_lod_pixels_per_triangle);
+
+        if (lod != nullptr) {
+            command_buffer.draw_indexed(lod->vertices, lod->indices, uniforms, instance.vs, instance.fs);
+        } else {
+            command_buffer.draw(instance.mesh->vertices, uniforms, instance.vs, instance.fs);
+        }
+    }
+
+    return m_visible.size();
+}
+
+size_t Scene::render(Rasterizer& rasterizer, Mat view_projection) {
+
+    m_command_buffer.reset();
+    m_command_buffer.set_state(rasterizer.get_state());
+    size_t count = record(m_command_buffer, view_projection,
+                          rasterizer.get_viewport_width(), rasterizer.get_viewport_height());
+    rasterizer.submit(m_command_buffer);
+
+    return count;
+}
+
+float Scene::get_projected_area(const Instance& instance, Mat view_projection,
+                                int viewport_width, int viewport_height) {
+
+    Mat mvp = view_projection * instance.transform->get_world();
+    return instance.mesh->sphere.transformed(mvp).get_projected_area(viewport_width, viewport_height);
+}
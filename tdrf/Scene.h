@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Mat.h"
+#include "Mesh.h"
+#include "Bounds.h"
+#include "Transform.h"
+#include "CommandBuffer.h"
+#include "types.h"
+
+class Rasterizer;
+
+// collection of mesh instances, organized in a bounding volume hierarchy
+// so that instances outside of the view frustum can be rejected before any
+// vertex gets shaded
+class Scene {
+public:
+    using InstanceId = uint32_t;
+
+    struct Instance {
+        const Mesh* mesh;
+        const Transform* transform;
+        VertexShader* vs;
+        FragmentShader* fs;
+        // world space bounds and the transform version they were computed from
+        Aabb world_aabb;
+        uint64_t transform_version;
+    };
+
+private:
+    struct BvhNode {
+        Aabb aabb;
+        // leaf: range into m_order, interior: count is 0 and the left child
+        // immediately follows its parent
+        uint32_t first = 0;
+        uint32_t count = 0;
+        uint32_t right = 0;
+        uint32_t parent = 0;
+    };
+
+    static constexpr uint32_t max_leaf_size = 4;
+
+    std::vector<Instance> m_instances;
+    std::vector<BvhNode> m_nodes;
+    // instance ids in leaf order
+    std::vector<InstanceId> m_order;
+    // leaf node of every instance
+    std::vector<uint32_t> m_leaf_of;
+    // leaves of instances moved since the last update, kept to avoid allocating every frame
+    std::vector<uint32_t> m_moved_leaves;
+    bool m_needs_rebuild = true;
+    // minimum average screen coverage of a triangle, used for selecting the level
+    // of detail of meshes
+    float m_lod_pixels_per_triangle = 4.0f;
+    // surface area of the root at the last full rebuild, refitting degrades the
+    // tree, so it gets rebuilt if the root grows too much
+    float m_built_area = 0.0f;
+    std::vector<InstanceId> m_visible;
+    CommandBuffer m_command_buffer;
+
+public:
+    InstanceId add_instance(const Mesh& mesh, const Transform& transform,
+                            FragmentShader* fs, VertexShader* vs = default_vertex_shader);
+
+    [[nodiscard]] const Instance& get_instance(InstanceId id) const {
+        return m_instances[id];
+    }
+
+    [[nodiscard]] size_t get_instance_count() const {
+        return m_instances.size();
+    }
+
+    [[nodiscard]] float get_lod_pixels_per_triangle() const {
+        return m_lod_pixels_per_triangle;
+    }
+
+    void set_lod_pixels_per_triangle(float pixels_per_triangle) {
+        m_lod_pixels_per_triangle = pixels_per_triangle;
+    }
+
+    // refits the bounds of moved instances, or rebuilds the hierarchy if needed
+    // transforms have to be updated before calling this
+    void update();
+
+    // appends the ids of all instances intersecting the frustum
+    void cull(const Frustum& frustum, std::vector<InstanceId>& visible) const;
+
+    // culls all instances, and records draws for the visible ones
+    // returns the amount of recorded instances
+    size_t record(CommandBuffer& command_buffer, Mat view_projection, int viewport_width, int viewport_height);
+
+    // culls and renders all instances with the current state of the rasterizer,
+    // returns the amount of rendered instances
+    size_t render(Rasterizer& rasterizer, Mat view_projection);
+
+private:
+    // approximate amount of pixels covered by an instance, based on its projected
+    // bounding sphere
+    [[nodiscard]] static float get_projected_area(const Instance& instance, Mat view_projection,
+                                                  int viewport_width, int viewport_height);
+
+    void rebuild();
+    uint32_t build_node(uint32_t first, uint32_t count, uint32_t parent);
+    void refit(uint32_t node);
+
+};
@@ -0,0 +1,199 @@
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SharedFrames.h"
+
+namespace {
+
+[[noreturn]] void throw_errno(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+[[nodiscard]] size_t round_to_pages(size_t size) {
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+[[nodiscard]] int create_shared_memory() {
+#ifdef __linux__
+    int fd = memfd_create("tdrf-frames", MFD_CLOEXEC);
+#else
+    // the name is only needed to create the segment, which lives on as long as
+    // it is mapped or open
+    std::string name = "/tdrf-frames-" + std::to_string(getpid());
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd != -1) shm_unlink(name.c_str());
+#endif
+    if (fd == -1) throw_errno("creating shared memory");
+    return fd;
+}
+
+// the layout of a segment mapped by a consumer, the header comes from another
+// process, so it is checked before anything is derived from it
+struct SegmentLayout {
+    size_t slot_offset;
+    size_t slot_size;
+};
+
+[[nodiscard]] std::optional<SegmentLayout> get_segment_layout(size_t slot_count, int width, int height,
+                                                              size_t header_size, size_t slot_info_size,
+                                                              size_t size) {
+    if (slot_count == 0 || width <= 0 || height <= 0) return std::nullopt;
+    // rules out overflows of the sizes below
+    if (slot_count > size / slot_info_size) return std::nullopt;
+    if (static_cast<size_t>(width) * height > size / sizeof(Color)) return std::nullopt;
+
+    size_t slot_offset = round_to_pages(header_size + slot_count * slot_info_size);
+    size_t slot_size = round_to_pages(static_cast<size_t>(width) * height * sizeof(Color));
+    if (slot_offset > size || slot_count > (size - slot_offset) / slot_size) return std::nullopt;
+
+    return SegmentLayout { slot_offset, slot_size };
+}
+
+} // namespace
+
+SharedFrameRing::SharedFrameRing(int width, int height, size_t slot_count)
+    : m_fd(create_shared_memory())
+    , m_width(width)
+    , m_height(height)
+    , m_slot_count(slot_count)
+{
+    assert(width > 0 && height > 0);
+    assert(slot_count > 0);
+
+    m_slot_offset = round_to_pages(sizeof(Header) + slot_count * sizeof(SlotInfo));
+    m_slot_size = round_to_pages(static_cast<size_t>(width) * height * sizeof(Color));
+    size_t size = m_slot_offset + slot_count * m_slot_size;
+
+    if (ftruncate(m_fd, size) == -1) {
+        close(m_fd);
+        throw_errno("resizing shared memory");
+    }
+    map(size);
+
+    // the segment starts out zeroed, so the slot infos don't need to be initialized
+    new (m_memory) Header {
+        .magic = magic,
+        .slot_count = static_cast<uint32_t>(slot_count),
+        .width = width,
+        .height = height,
+        .published = 0,
+        .released = 0,
+    };
+}
+
+SharedFrameRing::SharedFrameRing(int fd)
+    : m_fd(dup(fd))
+{
+    if (m_fd == -1) throw_errno("duplicating shared memory descriptor");
+
+    struct stat info;
+    if (fstat(m_fd, &info) == -1) {
+        close(m_fd);
+        throw_errno("reading shared memory size");
+    }
+    if (static_cast<size_t>(info.st_size) < sizeof(Header)) {
+        close(m_fd);
+        throw std::runtime_error("shared memory is too small for a frame ring");
+    }
+    map(info.st_size);
+
+    // every field is read once, the copies are checked and used from then on
+    const Header& header = get_header();
+    uint32_t header_magic = header.magic;
+    m_slot_count = header.slot_count;
+    m_width = header.width;
+    m_height = header.height;
+
+    std::optional<SegmentLayout> layout;
+    if (header_magic == magic) {
+        layout = get_segment_layout(m_slot_count, m_width, m_height, sizeof(Header), sizeof(SlotInfo), m_size);
+    }
+
+    if (!layout) {
+        munmap(m_memory, m_size);
+        close(m_fd);
+        throw std::runtime_error("shared memory doesn't hold a valid frame ring");
+    }
+    m_slot_offset = layout->slot_offset;
+    m_slot_size = layout->slot_size;
+}
+
+SharedFrameRing::~SharedFrameRing() {
+    munmap(m_memory, m_size);
+    close(m_fd);
+}
+
+void SharedFrameRing::map(size_t size) {
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (memory == MAP_FAILED) {
+        close(m_fd);
+        throw_errno("mapping shared memory");
+    }
+    m_memory = static_cast<std::byte*>(memory);
+    m_size = size;
+}
+
+std::span<Color> SharedFrameRing::begin_frame() {
+    Header& header = get_header();
+    // only the producer writes the amount of published frames
+    uint64_t published = header.published.load(std::memory_order_relaxed);
+    // the consumer has to be done reading the slot before it is overwritten
+    uint64_t released = header.released.load(std::memory_order_acquire);
+
+    if (published - released >= m_slot_count) return {};
+
+    return { get_slot_pixels(published), static_cast<size_t>(m_width) * m_height };
+}
+
+void SharedFrameRing::end_frame() {
+    Header& header = get_header();
+    uint64_t published = header.published.load(std::memory_order_relaxed);
+    assert(published - header.released.load(std::memory_order_relaxed) < m_slot_count);
+
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    get_slot_info(published) = {
+        .sequence = published,
+        .publish_time = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(),
+    };
+
+    // the pixels and the slot info become visible together with the counter
+    header.published.store(published + 1, std::memory_order_release);
+}
+
+std::optional<SharedFrameRing::Frame> SharedFrameRing::acquire_frame() const {
+    Header& header = get_header();
+    // only the consumer writes the amount of released frames
+    uint64_t released = header.released.load(std::memory_order_relaxed);
+    uint64_t published = header.published.load(std::memory_order_acquire);
+
+    if (released == published) return std::nullopt;
+
+    const SlotInfo& info = get_slot_info(released);
+    return Frame {
+        .sequence = info.sequence,
+        .publish_time = info.publish_time,
+        .width = m_width,
+        .height = m_height,
+        .pixels = { get_slot_pixels(released), static_cast<size_t>(m_width) * m_height },
+    };
+}
+
+void SharedFrameRing::release_frame() {
+    Header& header = get_header();
+    uint64_t released = header.released.load(std::memory_order_relaxed);
+    assert(released < header.published.load(std::memory_order_relaxed));
+
+    header.released.store(released + 1, std::memory_order_release);
+}
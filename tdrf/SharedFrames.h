@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include "Color.h"
+
+// ring of frames in a shared memory segment, through which finished frames are
+// handed to another process (e.g. an encoder) without copying them
+// there is a single producer, which renders into the slots of the ring, and a
+// single consumer, which maps the same segment and reads them in place, the
+// slots are handed over by two sequence counters, without any locks
+class SharedFrameRing {
+public:
+    // frame in a slot of the ring, which stays valid until it is released
+    struct Frame {
+        // number of the frame, counting every published frame from zero
+        uint64_t sequence;
+        // steady clock time in nanoseconds, at which the frame was published
+        int64_t publish_time;
+        int width;
+        int height;
+        std::span<const Color> pixels;
+    };
+
+private:
+    // start of the segment, the slots follow it, every slot starts on a page of its own
+    struct Header {
+        uint32_t magic;
+        uint32_t slot_count;
+        int32_t width;
+        int32_t height;
+        // amount of published and released frames, on separate cache lines, as
+        // they are written by different processes
+        alignas(64) std::atomic<uint64_t> published;
+        alignas(64) std::atomic<uint64_t> released;
+    };
+
+    // written by the producer before the frame is published
+    struct SlotInfo {
+        uint64_t sequence;
+        int64_t publish_time;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "counters have to be usable across processes");
+
+    static constexpr uint32_t magic = 0x66726474; // "tdrf"
+
+    int m_fd = -1;
+    std::byte* m_memory = nullptr;
+    size_t m_size = 0;
+    size_t m_slot_offset = 0;
+    size_t m_slot_size = 0;
+    // copies of the header, which the other process could still change after
+    // it has been checked
+    int m_width = 0;
+    int m_height = 0;
+    size_t m_slot_count = 0;
+
+public:
+    // creates a new segment, the calling process is the producer
+    SharedFrameRing(int width, int height, size_t slot_count = 3);
+
+    // maps the segment of the file descriptor, which the consumer got from the
+    // producer, e.g. by inheriting it, over a unix socket, or from /proc/<pid>/fd
+    // throws std::runtime_error if the segment isn't a frame ring, or its header
+    // doesn't fit into the segment, and std::system_error if it can't be mapped
+    explicit SharedFrameRing(int fd);
+
+    ~SharedFrameRing();
+    SharedFrameRing(const SharedFrameRing&) = delete;
+    SharedFrameRing& operator=(const SharedFrameRing&) = delete;
+
+    [[nodiscard]] int get_fd() const {
+        return m_fd;
+    }
+
+    [[nodiscard]] int get_width() const {
+        return m_width;
+    }
+
+    [[nodiscard]] int get_height() const {
+        return m_height;
+    }
+
+    [[nodiscard]] size_t get_slot_count() const {
+        return m_slot_count;
+    }
+
+    // pixels of the next free slot, row by row, which the producer renders into
+    // (e.g. with Buffer::set_storage()), empty if the consumer still holds all
+    // slots, the previous contents of the slot are undefined
+    [[nodiscard]] std::span<Color> begin_frame();
+
+    // makes the frame started by begin_frame() visible to the consumer
+    void end_frame();
+
+    // oldest published frame, which the consumer hasn't released yet
+    [[nodiscard]] std::optional<Frame> acquire_frame() const;
+
+    // hands the slot of the acquired frame back to the producer
+    void release_frame();
+
+private:
+    [[nodiscard]] Header& get_header() const {
+        return *reinterpret_cast<Header*>(m_memory);
+    }
+
+    [[nodiscard]] SlotInfo& get_slot_info(uint64_t sequence) const {
+        auto infos = reinterpret_cast<SlotInfo*>(m_memory + sizeof(Header));
+        return infos[sequence % m_slot_count];
+    }
+
+    [[nodiscard]] Color* get_slot_pixels(uint64_t sequence) const {
+        return reinterpret_cast<Color*>(m_memory + m_slot_offset + sequence % m_slot_count * m_slot_size);
+    }
+
+    void map(size_t size);
+
+};
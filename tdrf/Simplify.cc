@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+#include "Simplify.h"
+
+namespace {
+
+// symmetric 4x4 error quadric, only the upper triangle is stored
+struct Quadric {
+    std::array<double, 10> q {};
+
+    [[nodiscard]] static Quadric from_plane(double a, double b, double c, double d, double weight) {
+        Quadric quadric;
+        quadric.q = {
+            a*a, a*b, a*c, a*d,
+                 b*b, b*c, b*d,
+                      c*c, c*d,
+                           d*d,
+        };
+        for (auto& value : quadric.q) {
+            value *= weight;
+        }
+        return quadric;
+    }
+
+    Quadric& operator+=(const Quadric& other) {
+        for (size_t i = 0; i < q.size(); ++i) {
+            q[i] += other.q[i];
+        }
+        return *this;
+    }
+
+    // squared distance of a point to all accumulated planes
+    [[nodiscard]] double error(Vec v) const {
+        double x = v.x, y = v.y, z = v.z;
+        return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+             + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+             + q[7]*z*z + 2*q[8]*z
+             + q[9];
+    }
+};
+
+struct Collapse {
+    double cost;
+    uint32_t u;
+    uint32_t v;
+    // versions of both vertices when this entry was pushed, outdated entries are skipped
+    uint32_t version_u;
+    uint32_t version_v;
+    Vec position;
+
+    [[nodiscard]] bool operator>(const Collapse& other) const {
+        return cost > other.cost;
+    }
+};
+
+[[nodiscard]] Vec triangle_normal(Vec a, Vec b, Vec c) {
+    Vec n = (b - a).cross(c - a);
+    n.w = 0.0f;
+    return n;
+}
+
+class Simplifier {
+    std::vector<Vec> m_vertices;
+    std::vector<uint32_t> m_indices;
+    std::vector<Quadric> m_quadrics;
+    std::vector<uint32_t> m_versions;
+    std::vector<bool> m_vertex_removed;
+    std::vector<bool> m_triangle_removed;
+    // triangles referencing every vertex, may contain removed triangles
+    std::vector<std::vector<uint32_t>> m_vertex_triangles;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> m_queue;
+    size_t m_triangle_count;
+
+public:
+    explicit Simplifier(const IndexedMesh& mesh)
+        : m_vertices(mesh.vertices)
+        , m_indices(mesh.indices)
+        , m_quadrics(mesh.vertices.size())
+        , m_versions(mesh.vertices.size(), 0)
+        , m_vertex_removed(mesh.vertices.size(), false)
+        , m_triangle_removed(mesh.get_triangle_count(), false)
+        , m_vertex_triangles(mesh.vertices.size())
+        , m_triangle_count(mesh.get_triangle_count())
+    {
+        compute_quadrics();
+
+        for (uint32_t t = 0; t < m_triangle_count; ++t) {
+            for (int i = 0; i < 3; ++i) {
+                m_vertex_triangles[m_indices[t*3 + i]].push_back(t);
+            }
+        }
+
+        for (uint32_t t = 0; t < m_triangle_count; ++t) {
+            for (int i = 0; i < 3; ++i) {
+                uint32_t u = m_indices[t*3 + i];
+                uint32_t v = m_indices[t*3 + (i+1) % 3];
+                // every interior edge is shared by two triangles, only push it once
+                if (u < v) push_collapse(u, v);
+                else if (is_boundary_edge(u, v)) push_collapse(v, u);
+            }
+        }
+    }
+
+    [[nodiscard]] IndexedMesh run(size_t target_triangles) {
+
+        while (m_triangle_count > target_triangles && !m_queue.empty()) {
+            Collapse collapse = m_queue.top();
+            m_queue.pop();
+
+            if (m_vertex_removed[collapse.u] || m_vertex_removed[collapse.v]) continue;
+            if (m_versions[collapse.u] != collapse.version_u) continue;
+            if (m_versions[collapse.v] != collapse.version_v) continue;
+            if (flips_triangle(collapse.u, collapse.v, collapse.position)) continue;
+            if (flips_triangle(collapse.v, collapse.u, collapse.position)) continue;
+
+            apply(collapse);
+        }
+
+        return compact();
+    }
+
+private:
+    void compute_quadrics() {
+
+        // every edge, with the number of triangles sharing it
+        std::unordered_map<uint64_t, int> edge_count;
+        auto edge_key = [](uint32_t u, uint32_t v) {
+            return (static_cast<uint64_t>(std::min(u, v)) << 32) | std::max(u, v);
+        };
+
+        for (uint32_t t = 0; t < m_triangle_count; ++t) {
+            for (int i = 0; i < 3; ++i) {
+                ++edge_count[edge_key(m_indices[t*3 + i], m_indices[t*3 + (i+1) % 3])];
+            }
+        }
+
+        for (uint32_t t = 0; t < m_triangle_count; ++t) {
+            const Vec& a = m_vertices[m_indices[t*3 + 0]];
+            const Vec& b = m_vertices[m_indices[t*3 + 1]];
+            const Vec& c = m_vertices[m_indices[t*3 + 2]];
+
+            Vec n = triangle_normal(a, b, c);
+            float area = n.length();
+            if (area == 0.0f) continue;
+            n = n / area;
+
+            auto plane = Quadric::from_plane(n.x, n.y, n.z, -n.dot(a), area);
+            for (int i = 0; i < 3; ++i) {
+                m_quadrics[m_indices[t*3 + i]] += plane;
+            }
+
+            // boundary edges get a heavily weighted plane perpendicular to the
+            // triangle, to keep the outline of open meshes in place
+            for (int i = 0; i < 3; ++i) {
+                uint32_t u = m_indices[t*3 + i];
+                uint32_t v = m_indices[t*3 + (i+1) % 3];
+                if (edge_count[edge_key(u, v)] != 1) continue;
+
+                Vec edge = m_vertices[v] - m_vertices[u];
+                edge.w = 0.0f;
+                Vec perpendicular = edge.cross(n);
+                float length = perpendicular.length();
+                if (length == 0.0f) continue;
+                perpendicular = perpendicular / length;
+
+                auto constraint = Quadric::from_plane(
+                    perpendicular.x, perpendicular.y, perpendicular.z,
+                    -perpendicular.dot(m_vertices[u]),
+                    area * 1000.0f);
+                m_quadrics[u] += constraint;
+                m_quadrics[v] += constraint;
+            }
+        }
+    }
+
+    [[nodiscard]] bool is_boundary_edge(uint32_t u, uint32_t v) const {
+        // the edge u -> v is shared if a triangle also contains v -> u
+        for (auto t : m_vertex_triangles[v]) {
+            for (int i = 0; i < 3; ++i) {
+                if (m_indices[t*3 + i] == v && m_indices[t*3 + (i+1) % 3] == u) return false;
+            }
+        }
+        return true;
+    }
+
+    void push_collapse(uint32_t u, uint32_t v) {
+        Quadric q = m_quadrics[u];
+        q += m_quadrics[v];
+
+        // the optimal position is not solved for, the best of the endpoints and
+        // the midpoint is taken instead
+        std::array candidates {
+            m_vertices[u],
+            m_vertices[v],
+            (m_vertices[u] + m_vertices[v]) * 0.5f,
+        };
+
+        Collapse collapse { std::numeric_limits<double>::max(), u, v, m_versions[u], m_versions[v], {} };
+        for (auto& candidate : candidates) {
+            double cost = q.error(candidate);
+            if (cost < collapse.cost) {
+                collapse.cost = cost;
+                collapse.position = candidate;
+            }
+        }
+
+        m_queue.push(collapse);
+    }
+
+    // checks if moving vertex u to position would flip one of its triangles,
+    // which are not removed by collapsing the edge to v
+    [[nodiscard]] bool flips_triangle(uint32_t u, uint32_t v, Vec position) const {
+        for (auto t : m_vertex_triangles[u]) {
+            if (m_triangle_removed[t]) continue;
+
+            const uint32_t* tri = &m_indices[t*3];
+            if (tri[0] == v || tri[1] == v || tri[2] == v) continue;
+
+            std::array corners { m_vertices[tri[0]], m_vertices[tri[1]], m_vertices[tri[2]] };
+            Vec before = triangle_normal(corners[0], corners[1], corners[2]);
+
+            for (int i = 0; i < 3; ++i) {
+                if (tri[i] == u) corners[i] = position;
+            }
+            Vec after = triangle_normal(corners[0], corners[1], corners[2]);
+
+            if (before.dot(after) <= 0.0f) return true;
+        }
+        return false;
+    }
+
+    void apply(const Collapse& collapse) {
+        uint32_t u = collapse.u;
+        uint32_t v = collapse.v;
+
+        m_vertices[u] = collapse.position;
+        m_quadrics[u] += m_quadrics[v];
+        m_vertex_removed[v] = true;
+        ++m_versions[u];
+
+        for (auto t : m_vertex_triangles[v]) {
+            if (m_triangle_removed[t]) continue;
+
+            uint32_t* tri = &m_indices[t*3];
+            for (int i = 0; i < 3; ++i) {
+                if (tri[i] == v) tri[i] = u;
+            }
+
+            if (tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0]) {
+                m_triangle_removed[t] = true;
+                --m_triangle_count;
+            } else {
+                m_vertex_triangles[u].push_back(t);
+            }
+        }
+        m_vertex_triangles[v].clear();
+
+        std::erase_if(m_vertex_triangles[u], [&](uint32_t t) { return m_triangle_removed[t]; });
+
+        // the costs of all edges around the new vertex have changed
+        for (auto t : m_vertex_triangles[u]) {
+            for (int i = 0; i < 3; ++i) {
+                uint32_t w = m_indices[t*3 + i];
+                if (w != u) push_collapse(std::min(u, w), std::max(u, w));
+            }
+        }
+    }
+
+    [[nodiscard]] IndexedMesh compact() const {
+        IndexedMesh mesh;
+        std::vector<uint32_t> remap(m_vertices.size(), UINT32_MAX);
+
+        for (uint32_t t = 0; t < m_triangle_removed.size(); ++t) {
+            if (m_triangle_removed[t]) continue;
+
+            for (int i = 0; i < 3; ++i) {
+                uint32_t index = m_indices[t*3 + i];
+                if (remap[index] == UINT32_MAX) {
+                    remap[index] = mesh.vertices.size();
+                    mesh.vertices.push_back(m_vertices[index]);
+                }
+                mesh.indices.push_back(remap[index]);
+            }
+        }
+
+        return mesh;
+    }
+
+};
+
+struct VecHash {
+    size_t operator()(Vec v) const {
+        size_t hash = std::bit_cast<uint32_t>(v.x);
+        hash = hash * 31 + std::bit_cast<uint32_t>(v.y);
+        hash = hash * 31 + std::bit_cast<uint32_t>(v.z);
+        return hash;
+    }
+};
+
+struct VecEqual {
+    bool operator()(Vec a, Vec b) const {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+};
+
+} // namespace
+
+IndexedMesh weld_vertices(std::span<const Vec> triangles) {
+
+    assert(triangles.size() % 3 == 0);
+
+    IndexedMesh mesh;
+    mesh.indices.reserve(triangles.size());
+    std::unordered_map<Vec, uint32_t, VecHash, VecEqual> lookup;
+
+    for (auto& vertex : triangles) {
+        auto [it, inserted] = lookup.try_emplace(vertex, mesh.vertices.size());
+        if (inserted) {
+            mesh.vertices.push_back(vertex);
+        }
+        mesh.indices.push_back(it->second);
+    }
+
+    return mesh;
+}
+
+IndexedMesh simplify(const IndexedMesh& mesh, size_t target_triangles) {
+    return Simplifier(mesh).run(target_triangles);
+}
+
+void generate_lods(Mesh& mesh, int levels, float ratio) {
+
+    assert(levels >= 1);
+    assert(ratio > 0.0f && ratio < 1.0f);
+
+    mesh.lods.clear();
+    mesh.lods.push_back(weld_vertices(mesh.vertices));
+
+    for (int level = 1; level < levels; ++level) {
+        const IndexedMesh& previous = mesh.lods.back();
+        auto target = static_cast<size_t>(previous.get_triangle_count() * ratio);
+        if (target == 0) break;
+
+        IndexedMesh lod = simplify(previous, target);
+        // the mesh can't be simplified any further
+        if (lod.get_triangle_count() >= previous.get_triangle_count()) break;
+
+        mesh.lods.push_back(std::move(lod));
+    }
+}
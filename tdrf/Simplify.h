@@ -0,0 +1,18 @@
+#pragma once
+
+#include <span>
+
+#include "Vec.h"
+#include "Mesh.h"
+
+// merges bitwise identical vertices of a triangle list
+[[nodiscard]] IndexedMesh weld_vertices(std::span<const Vec> triangles);
+
+// reduces the triangle count of a mesh to at most target_triangles, by collapsing
+// the edges with the lowest quadric error (Garland and Heckbert)
+// stops early if no edge can be collapsed without flipping a triangle
+[[nodiscard]] IndexedMesh simplify(const IndexedMesh& mesh, size_t target_triangles);
+
+// fills mesh.lods with the welded full resolution mesh, followed by levels-1
+// simplified levels, each with ratio times the triangles of the previous level
+void generate_lods(Mesh& mesh, int levels, float ratio = 0.5f);
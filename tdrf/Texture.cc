@@ -0,0 +1,46 @@
+#include "Texture.h"
+
+Texture::Texture(const ColorBuffer& image) {
+
+    auto make_level = [](int width, int height) {
+        int tiles_x = (width + tile_size - 1) / tile_size;
+        int tiles_y = (height + tile_size - 1) / tile_size;
+        return Level {
+            width,
+            height,
+            tiles_x,
+            std::vector<Color>(tiles_x * tiles_y * tile_size * tile_size),
+        };
+    };
+
+    Level& base = m_levels.emplace_back(make_level(image.get_width(), image.get_height()));
+    for (int y = 0; y < base.height; ++y) {
+        for (int x = 0; x < base.width; ++x) {
+            base.texels[get_tiled_index(base, x, y)] = image.get(x, y);
+        }
+    }
+
+    while (m_levels.back().width > 1 || m_levels.back().height > 1) {
+        const Level& previous = m_levels.back();
+        Level level = make_level(std::max(previous.width / 2, 1), std::max(previous.height / 2, 1));
+
+        for (int y = 0; y < level.height; ++y) {
+            for (int x = 0; x < level.width; ++x) {
+                // clamped, for levels with an odd or unit size
+                int x0 = std::min(x * 2, previous.width - 1);
+                int y0 = std::min(y * 2, previous.height - 1);
+                int x1 = std::min(x * 2 + 1, previous.width - 1);
+                int y1 = std::min(y * 2 + 1, previous.height - 1);
+
+                f32x4 sum = to_f32x4(previous.texels[get_tiled_index(previous, x0, y0)])
+                          + to_f32x4(previous.texels[get_tiled_index(previous, x1, y0)])
+                          + to_f32x4(previous.texels[get_tiled_index(previous, x0, y1)])
+                          + to_f32x4(previous.texels[get_tiled_index(previous, x1, y1)]);
+
+                level.texels[get_tiled_index(level, x, y)] = to_color(sum * 0.25f);
+            }
+        }
+
+        m_levels.push_back(std::move(level));
+    }
+}
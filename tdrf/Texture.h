@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "Vec.h"
+#include "Color.h"
+#include "Buffer.h"
+#include "simd.h"
+
+// sampled image with a full mip chain, texture coordinates wrap around
+// texels are stored in 4x4 tiles, so that a bilinear footprint usually lies
+// within a single cache line
+class Texture {
+    static constexpr int tile_size = 4;
+    static constexpr int tile_bits = 2;
+
+    struct Level {
+        int width;
+        int height;
+        int tiles_x;
+        std::vector<Color> texels;
+    };
+
+    std::vector<Level> m_levels;
+
+public:
+    // generates the mip chain by repeatedly downsampling the image with a box filter
+    explicit Texture(const ColorBuffer& image);
+
+    [[nodiscard]] int get_width() const {
+        return m_levels.front().width;
+    }
+
+    [[nodiscard]] int get_height() const {
+        return m_levels.front().height;
+    }
+
+    [[nodiscard]] int get_level_count() const {
+        return m_levels.size();
+    }
+
+    [[nodiscard]] Color get_texel(int level, int x, int y) const {
+        const Level& l = m_levels[level];
+        assert(x >= 0 && x < l.width);
+        assert(y >= 0 && y < l.height);
+        return l.texels[get_tiled_index(l, x, y)];
+    }
+
+    // mip level for the given screen space derivatives of the texture coordinates
+    [[nodiscard]] float compute_lod(Vec uv_dx, Vec uv_dy) const {
+        float dx = std::hypot(uv_dx.x * get_width(), uv_dx.y * get_height());
+        float dy = std::hypot(uv_dy.x * get_width(), uv_dy.y * get_height());
+        float rho = std::max(dx, dy);
+        if (rho <= 1.0f) return 0.0f;
+        return std::min(std::log2(rho), static_cast<float>(get_level_count() - 1));
+    }
+
+    [[nodiscard]] Color sample_nearest(Vec uv, int level = 0) const {
+        const Level& l = m_levels[level];
+        int x = wrap(static_cast<int>(std::floor(uv.x * l.width)), l.width);
+        int y = wrap(static_cast<int>(std::floor(uv.y * l.height)), l.height);
+        return l.texels[get_tiled_index(l, x, y)];
+    }
+
+    [[nodiscard]] Color sample_bilinear(Vec uv, int level = 0) const {
+        return to_color(sample_bilinear_f32(uv, level));
+    }
+
+    // trilinear filtering, with the mip level derived from the derivatives
+    [[nodiscard]] Color sample(Vec uv, Vec uv_dx, Vec uv_dy) const {
+        float lod = compute_lod(uv_dx, uv_dy);
+        int level = static_cast<int>(lod);
+        float t = lod - level;
+
+        f32x4 result = sample_bilinear_f32(uv, level);
+        if (t > 0.0f && level + 1 < get_level_count()) {
+            f32x4 next = sample_bilinear_f32(uv, level + 1);
+            result = result + (next - result) * t;
+        }
+
+        return to_color(result);
+    }
+
+private:
+    [[nodiscard]] static int get_tiled_index(const Level& level, int x, int y) {
+        int tile = (y >> tile_bits) * level.tiles_x + (x >> tile_bits);
+        int offset = ((y & (tile_size-1)) << tile_bits) | (x & (tile_size-1));
+        return (tile << (2 * tile_bits)) | offset;
+    }
+
+    [[nodiscard]] static int wrap(int value, int size) {
+        int result = value % size;
+        return result < 0 ? result + size : result;
+    }
+
+    [[nodiscard]] f32x4 sample_bilinear_f32(Vec uv, int level) const {
+        const Level& l = m_levels[level];
+
+        // texel centers are at half integer coordinates
+        float u = uv.x * l.width - 0.5f;
+        float v = uv.y * l.height - 0.5f;
+        float u_floor = std::floor(u);
+        float v_floor = std::floor(v);
+        float fu = u - u_floor;
+        float fv = v - v_floor;
+
+        int x0 = wrap(static_cast<int>(u_floor), l.width);
+        int y0 = wrap(static_cast<int>(v_floor), l.height);
+        int x1 = x0 + 1 == l.width ? 0 : x0 + 1;
+        int y1 = y0 + 1 == l.height ? 0 : y0 + 1;
+
+        f32x4 t00 = to_f32x4(l.texels[get_tiled_index(l, x0, y0)]);
+        f32x4 t10 = to_f32x4(l.texels[get_tiled_index(l, x1, y0)]);
+        f32x4 t01 = to_f32x4(l.texels[get_tiled_index(l, x0, y1)]);
+        f32x4 t11 = to_f32x4(l.texels[get_tiled_index(l, x1, y1)]);
+
+        f32x4 top = t00 + (t10 - t00) * fu;
+        f32x4 bottom = t01 + (t11 - t01) * fu;
+        return top + (bottom - top) * fv;
+    }
+
+};
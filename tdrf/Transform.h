@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Mat.h"
+
+// node of a transform hierarchy
+// world matrices are cached, and only recomputed by update() if the node itself
+// or one of its ancestors has changed since the last update
+class Transform {
+    Transform* m_parent = nullptr;
+    std::vector<Transform*> m_children;
+    Mat m_local = Mat::identity();
+    Mat m_world = Mat::identity();
+    bool m_dirty = true;
+    // incremented whenever the world matrix changes
+    uint64_t m_version = 0;
+
+public:
+    Transform() = default;
+
+    explicit Transform(Mat local) : m_local(local) { }
+
+    Transform(const Transform&) = delete;
+    Transform& operator=(const Transform&) = delete;
+
+    ~Transform() {
+        set_parent(nullptr);
+        for (auto* child : m_children) {
+            child->m_parent = nullptr;
+            child->m_dirty = true;
+        }
+    }
+
+    [[nodiscard]] Transform* get_parent() const {
+        return m_parent;
+    }
+
+    void set_parent(Transform* parent) {
+        if (m_parent != nullptr) {
+            std::erase(m_parent->m_children, this);
+        }
+
+        m_parent = parent;
+        m_dirty = true;
+
+        if (m_parent != nullptr) {
+            m_parent->m_children.push_back(this);
+        }
+    }
+
+    [[nodiscard]] const std::vector<Transform*>& get_children() const {
+        return m_children;
+    }
+
+    [[nodiscard]] Mat get_local() const {
+        return m_local;
+    }
+
+    void set_local(Mat local) {
+        m_local = local;
+        m_dirty = true;
+    }
+
+    [[nodiscard]] bool is_dirty() const {
+        return m_dirty;
+    }
+
+    // world matrix as of the last call to update()
+    [[nodiscard]] Mat get_world() const {
+        return m_world;
+    }
+
+    [[nodiscard]] uint64_t get_version() const {
+        return m_version;
+    }
+
+    // recomputes the world matrices of this subtree, should be called once per
+    // frame on every root node
+    void update() {
+        update(m_parent == nullptr ? Mat::identity() : m_parent->m_world, false);
+    }
+
+private:
+    void update(Mat parent_world, bool parent_changed) {
+        bool changed = m_dirty || parent_changed;
+
+        if (changed) {
+            m_world = m_parent == nullptr ? m_local : parent_world * m_local;
+            m_dirty = false;
+            ++m_version;
+        }
+
+        for (auto* child : m_children) {
+            child->update(m_world, changed);
+        }
+    }
+
+};
@@ -0,0 +1,190 @@
+#include <cassert>
+#include <cstring>
+
+#include "VertexFormat.h"
+#include "Bounds.h"
+#include "simd.h"
+
+namespace {
+
+// largest value of 16-bit signed normalized numbers
+constexpr float snorm_max = 32767.0f;
+
+[[nodiscard]] uint32_t encode_attribute(Vec attribute, AttributeFormat format) {
+    switch (format) {
+        using enum AttributeFormat;
+
+        case Octahedral: {
+            auto [x, y] = octahedral_encode(attribute);
+            auto snorm = [](float value) {
+                return static_cast<uint16_t>(static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * snorm_max)));
+            };
+            return snorm(x) | static_cast<uint32_t>(snorm(y)) << 16;
+        }
+
+        case Half2:
+            return Half::from_float(attribute.x).bits | static_cast<uint32_t>(Half::from_float(attribute.y).bits) << 16;
+
+        case None: return 0;
+        default: assert(!"invalid attribute format");
+    }
+    return 0;
+}
+
+// the two 16-bit halves of every lane, sign extended
+[[nodiscard]] std::array<i32x4, 2> unpack_int16(i32x4 packed) {
+    return { (packed << 16) >> 16, packed >> 16 };
+}
+
+// lanes of a where the mask is set, and of b elsewhere
+[[nodiscard]] f32x4 select(i32x4 mask, f32x4 a, f32x4 b) {
+    return std::bit_cast<f32x4>((mask & std::bit_cast<i32x4>(a)) | (~mask & std::bit_cast<i32x4>(b)));
+}
+
+[[nodiscard]] f32x4 abs(f32x4 value) {
+    return std::bit_cast<f32x4>(std::bit_cast<i32x4>(value) & 0x7fffffff);
+}
+
+// converts the 16-bit floats in the lower half of every lane, infinity and nan
+// become large finite values, which don't occur in attributes anyway
+[[nodiscard]] f32x4 half_to_float(i32x4 bits) {
+    i32x4 sign = (bits & 0x8000) << 16;
+    // moving the exponent and mantissa into place, and multiplying by 2^112
+    // rebiases the exponent from 15 to 127, which also turns subnormals into normals
+    f32x4 magnitude = std::bit_cast<f32x4>((bits & 0x7fff) << 13) * 0x1p112f;
+    return std::bit_cast<f32x4>(std::bit_cast<i32x4>(magnitude) | sign);
+}
+
+} // namespace
+
+QuantizedVertices QuantizedVertices::quantize(std::span<const Vec> positions, std::span<const Vec> attributes,
+                                              AttributeFormat attribute_format) {
+
+    assert(attributes.empty() || attributes.size() == positions.size());
+    assert(attributes.empty() || attribute_format != AttributeFormat::None);
+
+    QuantizedVertices result;
+    Aabb bounds = Aabb::from_points(positions);
+    Vec extent = bounds.is_empty() ? Vec {} : bounds.extent();
+
+    result.offset = bounds.is_empty() ? Vec {} : bounds.min;
+    result.scale = extent * (1.0f / 0xffff);
+    result.scale.w = 0.0f;
+    result.offset.w = 1.0f;
+
+    // flat axes are stored as zero
+    auto to_unorm16 = [](float value, float min, float extent) {
+        if (extent == 0.0f) return uint16_t { 0 };
+        return static_cast<uint16_t>(std::lround(std::clamp((value - min) / extent, 0.0f, 1.0f) * 0xffff));
+    };
+
+    result.positions.reserve(positions.size());
+    for (auto& p : positions) {
+        result.positions.push_back({
+            to_unorm16(p.x, bounds.min.x, extent.x),
+            to_unorm16(p.y, bounds.min.y, extent.y),
+            to_unorm16(p.z, bounds.min.z, extent.z),
+            0,
+        });
+    }
+
+    if (!attributes.empty()) {
+        result.attribute_format = attribute_format;
+        result.attributes.reserve(attributes.size());
+        for (auto& attribute : attributes) {
+            result.attributes.push_back(encode_attribute(attribute, attribute_format));
+        }
+    }
+
+    return result;
+}
+
+Vec QuantizedVertices::get_attribute(size_t index) const {
+    if (attribute_format == AttributeFormat::None) return {};
+
+    uint32_t packed = attributes[index];
+    auto low = static_cast<uint16_t>(packed);
+    auto high = static_cast<uint16_t>(packed >> 16);
+
+    switch (attribute_format) {
+        using enum AttributeFormat;
+
+        case Octahedral: {
+            float x = std::max(static_cast<int16_t>(low) / snorm_max, -1.0f);
+            float y = std::max(static_cast<int16_t>(high) / snorm_max, -1.0f);
+            return octahedral_decode(x, y);
+        }
+
+        case Half2: return { Half { low }.to_float(), Half { high }.to_float(), 0.0f, 0.0f };
+        default: assert(!"invalid attribute format");
+    }
+    return {};
+}
+
+void QuantizedVertices::decode_positions(size_t first, std::span<Vec> out) const {
+
+    assert(first + out.size() <= positions.size());
+
+    // the w of the scale is zero, and the w of the offset one
+    f32x4 scale_4 = std::bit_cast<f32x4>(scale);
+    f32x4 offset_4 = std::bit_cast<f32x4>(offset);
+
+    for (size_t i = 0; i < out.size(); ++i) {
+        u16x4 position;
+        std::memcpy(&position, &positions[first + i], sizeof(position));
+        out[i] = std::bit_cast<Vec>(__builtin_convertvector(position, f32x4) * scale_4 + offset_4);
+    }
+}
+
+void QuantizedVertices::decode_attributes(size_t first, std::span<Vec> out) const {
+
+    if (attribute_format == AttributeFormat::None) {
+        std::ranges::fill(out, Vec {});
+        return;
+    }
+
+    assert(first + out.size() <= attributes.size());
+
+    // every lane holds the attribute of a vertex
+    auto decode = [&](i32x4 packed) -> std::array<f32x4, 3> {
+        auto [low, high] = unpack_int16(packed);
+
+        if (attribute_format == AttributeFormat::Half2) {
+            return { half_to_float(low), half_to_float(high), f32x4 {} };
+        }
+
+        // the same steps as octahedral_decode(), -32768 is clamped to -1
+        f32x4 x = __builtin_convertvector(low, f32x4) * (1.0f / snorm_max);
+        f32x4 y = __builtin_convertvector(high, f32x4) * (1.0f / snorm_max);
+        f32x4 minus_one = f32x4 {} - 1.0f;
+        x = select(x < minus_one, minus_one, x);
+        y = select(y < minus_one, minus_one, y);
+        f32x4 z = 1.0f - abs(x) - abs(y);
+
+        f32x4 fold = select(z < 0.0f, -z, f32x4 {});
+        // subtracts the fold from positive coordinates, and adds it to negative ones
+        x -= std::bit_cast<f32x4>(std::bit_cast<i32x4>(fold) | (std::bit_cast<i32x4>(x) & INT32_MIN));
+        y -= std::bit_cast<f32x4>(std::bit_cast<i32x4>(fold) | (std::bit_cast<i32x4>(y) & INT32_MIN));
+
+        f32x4 length_squared = x * x + y * y + z * z;
+        f32x4 length;
+        for (int lane = 0; lane < 4; ++lane) {
+            length[lane] = std::sqrt(length_squared[lane]);
+        }
+        return { x / length, y / length, z / length };
+    };
+
+    size_t i = 0;
+    for (; i + 4 <= out.size(); i += 4) {
+        i32x4 packed;
+        std::memcpy(&packed, &attributes[first + i], sizeof(packed));
+        auto [x, y, z] = decode(packed);
+        for (int lane = 0; lane < 4; ++lane) {
+            out[i + lane] = { x[lane], y[lane], z[lane], 0.0f };
+        }
+    }
+
+    for (; i < out.size(); ++i) {
+        out[i] = get_attribute(first + i);
+    }
+}
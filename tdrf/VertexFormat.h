@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "Half.h"
+#include "Vec.h"
+
+// formats of the per-vertex attribute of quantized vertices, every one takes 4 bytes
+enum class AttributeFormat {
+    // no attribute, fragments get a zero vector
+    None,
+    // unit vectors (e.g. normals) mapped onto an octahedron, stored as two 16-bit
+    // signed normalized values, decoded with w = 0
+    Octahedral,
+    // two 16-bit floats (e.g. texture coordinates), decoded to x and y
+    Half2,
+};
+
+// maps a unit vector to a point in [-1, 1]^2, the upper half of the sphere is
+// projected onto the inner diamond of the square, the lower half is folded over
+// its edges into the corners
+[[nodiscard]] inline std::array<float, 2> octahedral_encode(Vec v) {
+    float sum = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+    float x = v.x / sum;
+    float y = v.y / sum;
+
+    if (v.z < 0.0f) {
+        float folded_x = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float folded_y = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = folded_x;
+        y = folded_y;
+    }
+
+    return { x, y };
+}
+
+[[nodiscard]] inline Vec octahedral_decode(float x, float y) {
+    Vec v { x, y, 1.0f - std::abs(x) - std::abs(y), 0.0f };
+    float fold = std::max(-v.z, 0.0f);
+    v.x += v.x >= 0.0f ? -fold : fold;
+    v.y += v.y >= 0.0f ? -fold : fold;
+    return v.normalized();
+}
+
+// vertices in compact formats, which take 12 bytes instead of the 32 bytes of a
+// position and an attribute vector, and are decoded while the vertices of a
+// draw are processed
+// positions are 16-bit integers spanning the bounds of the mesh, the fourth is
+// unused, so that every position is a single 8-byte load
+struct QuantizedVertices {
+    std::vector<std::array<uint16_t, 4>> positions;
+    // positions are decoded to positions * scale + offset, the w of both is unused
+    Vec scale;
+    Vec offset;
+    AttributeFormat attribute_format = AttributeFormat::None;
+    // one per vertex, unless the format is None
+    std::vector<uint32_t> attributes;
+
+    // the precision of the positions is the extent of their bounds along every
+    // axis divided by 65535, attributes is either empty or holds one attribute
+    // per position, which is stored in the given format
+    [[nodiscard]] static QuantizedVertices quantize(std::span<const Vec> positions,
+                                                    std::span<const Vec> attributes = {},
+                                                    AttributeFormat attribute_format = AttributeFormat::None);
+
+    [[nodiscard]] size_t size() const {
+        return positions.size();
+    }
+
+    [[nodiscard]] Vec get_position(size_t index) const {
+        auto& p = positions[index];
+        return { p[0] * scale.x + offset.x, p[1] * scale.y + offset.y, p[2] * scale.z + offset.z, 1.0f };
+    }
+
+    [[nodiscard]] Vec get_attribute(size_t index) const;
+
+    // decode the vertices [first, first + out.size()) to out, with 4-wide vectors
+    void decode_positions(size_t first, std::span<Vec> out) const;
+    void decode_attributes(size_t first, std::span<Vec> out) const;
+
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
 
 [[nodiscard]] inline constexpr float deg_to_rad(float deg) {
     return deg * (M_PI / 180.0);
@@ -9,3 +10,11 @@
 [[nodiscard]] inline constexpr float rad_to_deg(float rad) {
     return rad * (180.0 / M_PI);
 }
+
+// mixes a value into a hash, with the finalizer of splitmix64
+[[nodiscard]] inline constexpr uint64_t hash_combine(uint64_t hash, uint64_t value) {
+    uint64_t x = hash ^ (value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2));
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+#include "Color.h"
+
+// portable 4-wide vector types, built on the gcc/clang vector extensions
+using f32x4 = float __attribute__((vector_size(16)));
+using i32x4 = int32_t __attribute__((vector_size(16)));
+
+// packs the results of a vector comparison into the lowest 4 bits
+[[nodiscard]] inline int movemask(i32x4 mask) {
+    return (mask[0] & 1) | (mask[1] & 2) | (mask[2] & 4) | (mask[3] & 8);
+}
+
+using u8x4 = uint8_t __attribute__((vector_size(4)));
+using u8x8 = uint8_t __attribute__((vector_size(8)));
+using u16x4 = uint16_t __attribute__((vector_size(8)));
+using u16x8 = uint16_t __attribute__((vector_size(16)));
+
+// converts the 4 channels of a color to floats, in the range [0, 255]
+[[nodiscard]] inline f32x4 to_f32x4(Color color) {
+    return __builtin_convertvector(std::bit_cast<u8x4>(color), f32x4);
+}
+
+// converts 4 floats in the range [0, 255] to a color, rounding to the nearest value
+[[nodiscard]] inline Color to_color(f32x4 value) {
+    i32x4 rounded = __builtin_convertvector(value + 0.5f, i32x4);
+    return std::bit_cast<Color>(__builtin_convertvector(rounded, u8x4));
+}
@@ -3,8 +3,22 @@
 #include "types.h"
 #include "math.h"
 #include "Mat.h"
+#include "Transform.h"
+#include "Bounds.h"
+#include "Mesh.h"
+#include "Simplify.h"
 #include "Vec.h"
 #include "Color.h"
 #include "Buffer.h"
+#include "Half.h"
+#include "VertexFormat.h"
+#include "Attachment.h"
+#include "Texture.h"
+#include "Light.h"
 #include "Framebuffer.h"
+#include "Arena.h"
+#include "JobSystem.h"
 #include "Rasterizer.h"
+#include "DynamicResolution.h"
+#include "SharedFrames.h"
+#include "Scene.h"
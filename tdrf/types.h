@@ -2,6 +2,7 @@
 
 #include "Color.h"
 #include "Vec.h"
+#include "Mat.h"
 
 struct Rectangle {
     float x, y, width, height;
@@ -9,16 +10,106 @@ struct Rectangle {
 
 static_assert(sizeof(Color) == 4);
 
-using VertexShader = Vec(Vec);
-using FragmentShader = Color(Vec);
+class Texture;
+class FragmentOutputs;
 
-[[nodiscard]] inline Vec default_vertex_shader(Vec pos) {
-    return pos;
+// per-draw uniform block, computed once per draw instead of once per vertex
+struct Uniforms {
+    Mat model = Mat::identity();
+    Mat view_projection = Mat::identity();
+    // model-view-projection, precomputed from the two matrices above
+    Mat mvp = Mat::identity();
+    const Texture* texture = nullptr;
+
+    [[nodiscard]] static constexpr Uniforms from_model(Mat model, Mat view_projection) {
+        return { model, view_projection, view_projection * model };
+    }
+};
+
+// inputs of the fragment shader
+struct Fragment {
+    // viewport coordinates of the pixel, z is the interpolated depth
+    Vec position;
+    // per-vertex attribute (e.g. texture coordinates), interpolated across the triangle
+    Vec attribute;
+    // screen space derivatives of the attribute, used for selecting texture mip levels
+    Vec attribute_dx;
+    Vec attribute_dy;
+};
+
+using VertexShader = Vec(Vec, const Uniforms&);
+using FragmentShader = Color(const Fragment&, const Uniforms&);
+// writes to any of the render targets of the framebuffer
+using MultiTargetShader = void(const Fragment&, const Uniforms&, FragmentOutputs&);
+
+// fragment shader of a draw, either returning a color which is blended into the
+// color buffer, or writing to multiple render targets
+struct FragmentStage {
+    FragmentShader* fs = nullptr;
+    MultiTargetShader* mts = nullptr;
+
+    FragmentStage(FragmentShader* fs) : fs(fs) { }
+    FragmentStage(MultiTargetShader* mts) : mts(mts) { }
+};
+
+[[nodiscard]] inline Vec default_vertex_shader(Vec pos, const Uniforms& uniforms) {
+    return uniforms.mvp * pos;
 }
 
-[[nodiscard]] inline Color default_fragment_shader(Vec) {
+[[nodiscard]] inline Color default_fragment_shader(const Fragment&, const Uniforms&) {
     return Color::blue();
 }
 
 enum class WindingOrder { Clockwise, CounterClockwise };
 enum class CullMode { Front, Back, None };
+// triangles are either filled, or only their edges or vertices are drawn
+enum class PolygonMode { Fill, Line, Point };
+
+// compares the reference value of a test to the stored one, as in reference < stored
+enum class CompareFunction { Never, Less, LessEqual, Equal, NotEqual, GreaterEqual, Greater, Always };
+
+// update of the stored stencil value, increments and decrements either clamp or wrap around
+enum class StencilOp { Keep, Zero, Replace, Invert, IncrementClamp, DecrementClamp, IncrementWrap, DecrementWrap };
+
+// the stencil test runs before the fragment shader together with the depth
+// test, fragments failing either of them aren't shaded
+struct StencilState {
+    bool enabled = false;
+    CompareFunction compare = CompareFunction::Always;
+    // applied if the stencil test fails, if only the depth test fails, and if both pass
+    StencilOp fail_op = StencilOp::Keep;
+    StencilOp depth_fail_op = StencilOp::Keep;
+    StencilOp pass_op = StencilOp::Keep;
+    uint8_t reference = 0;
+    // bits of the reference and stored value which are compared
+    uint8_t read_mask = 0xff;
+    // bits of the stored value which are updated
+    uint8_t write_mask = 0xff;
+
+    constexpr auto operator<=>(const StencilState&) const = default;
+};
+
+// fixed function state, which may change per draw
+struct PipelineState {
+    // vertex winding order of front face triangles
+    WindingOrder winding_order = WindingOrder::CounterClockwise;
+    CullMode cull_mode = CullMode::None;
+    PolygonMode polygon_mode = PolygonMode::Fill;
+    // smooths the edges of lines and points by their pixel coverage
+    bool antialiasing = false;
+    StencilState stencil;
+    // fragments failing the depth test are discarded
+    bool depth_test = true;
+    bool depth_write = true;
+    // fragments of draws without color writes only update depth and stencil,
+    // the fragment shader isn't run
+    bool color_write = true;
+    // colors are alpha blended into the color buffer, otherwise they replace it
+    bool blending = true;
+    // fragments of transparent draws are blended back to front once all draws of
+    // a submission have been rasterized, independently of the order of the draws
+    // they are always hidden by opaque surfaces in front of them, and don't write the depth
+    bool transparent = false;
+
+    constexpr auto operator<=>(const PipelineState&) const = default;
+};